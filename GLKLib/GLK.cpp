@@ -27,6 +27,22 @@ GLK::GLK()
 	m_Profile=true;
 
 	m_mouseState=0;		m_bCoordDisp=false;
+	m_currentPntIndex=-1;
+
+	m_bFrameStatsDisp=false;	m_bFrameTrace=false;	m_bFrameTiming=false;
+	const char *traceFile=getenv("PNTWORKS_FRAME_TRACE");
+	if (traceFile!=NULL && traceFile[0]!='\0') SetFrameTraceFile(traceFile);
+
+	m_bOffscreen=false;
+	m_bInvalid=true;	m_frameInterval=16;	m_lastFrameTime=0;	m_lastFrameDuration=0;
+	m_bInteracting=false;	m_settleTime=200;	m_lastInteractionTime=0;
+}
+
+bool GLK::SetFrameTraceFile(const char *filename)
+{
+	bool bOpened=m_frameTimer.SetTraceFile(filename);
+	m_bFrameTrace=(filename!=NULL && bOpened);
+	return bOpened;
 }
 
 GLK::~GLK()
@@ -195,6 +211,13 @@ void GLK::draw_polyline_2d(int pointNum, const float pts[], bool bFill)
 	//	The following lines are drawing axis.
 	if (m_axisDisplay) GLDrawAxis();
 
+	////////////////////////////////////////////////////////////////
+	//	The matrices of this frame, before the objects are drawn so
+	//	that they can cull against the view
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelMatrix);
+	glGetDoublev(GL_PROJECTION_MATRIX, projMatrix);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
 	////////////////////////////////////////////////////////////////
 	//	The following lines are drawing Object.
 	//		Default rendering 
@@ -203,10 +226,6 @@ void GLK::draw_polyline_2d(int pointNum, const float pts[], bool bFill)
 	////////////////////////////////////////////////////////////////
 	//	The following lines are drawing GLList.
 	GLDrawGLList();
-
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelMatrix);
-	glGetDoublev(GL_PROJECTION_MATRIX, projMatrix);
-	glGetIntegerv(GL_VIEWPORT, viewport);
 	GLDisableLight();
 
     glColor3f(m_red,m_green,m_blue);
@@ -238,6 +257,19 @@ void GLK::screen_to_wcl(double sx, double sy, double &cx, double &cy, double &cz
 	cx=objx;	cy=objy;	cz=objz;
 }
 
+void GLK::screen_to_ray(double sx, double sy, double origin[], double dir[])
+{
+	GLdouble farx, fary, farz;
+	double y = m_SizeY - sy;
+
+	gluUnProject(sx, y, 0.0, modelMatrix, projMatrix, viewport, &origin[0], &origin[1], &origin[2]);
+	gluUnProject(sx, y, 1.0, modelMatrix, projMatrix, viewport, &farx, &fary, &farz);
+
+	dir[0]=farx-origin[0];	dir[1]=fary-origin[1];	dir[2]=farz-origin[2];
+	double length=sqrt(dir[0]*dir[0]+dir[1]*dir[1]+dir[2]*dir[2]);
+	if (length>0.0) {dir[0]/=length;	dir[1]/=length;	dir[2]/=length;}
+}
+
 void GLK::wcl_to_screen(double cx, double cy, double cz, double &sx, double &sy)
 {
 	GLdouble winx, winy, winz;
@@ -290,8 +322,32 @@ void GLK::setViewport()
 	glLoadIdentity();
 }
 
+void GLK::Invalidate(bool bInteractive)
+{
+	m_bInvalid=true;
+	if (bInteractive) {
+		m_bInteracting=true;	m_lastInteractionTime=glutGet(GLUT_ELAPSED_TIME);
+	}
+}
+
+bool GLK::RefreshIfInvalid()
+{
+	int time=glutGet(GLUT_ELAPSED_TIME);
+	if (m_bInteracting && time-m_lastInteractionTime>=m_settleTime) {
+		m_bInteracting=false;	m_bInvalid=true;
+	}
+	if (!m_bInvalid) return false;
+	if (time-m_lastFrameTime<m_frameInterval) return false;
+	refresh();
+	return true;
+}
+
 void GLK::refresh()
 {
+	m_bInvalid=false;	m_lastFrameTime=glutGet(GLUT_ELAPSED_TIME);
+	m_bFrameTiming=!m_bOffscreen && (m_bFrameStatsDisp || m_bFrameTrace);
+	if (m_bFrameTiming) m_frameTimer.BeginFrame();
+
 	glPushMatrix();
 
 	setViewport();
@@ -299,7 +355,9 @@ void GLK::refresh()
 	glClearColor(m_ClearColorRed,m_ClearColorGreen,m_ClearColorBlue,1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	if (m_bFrameTiming) m_frameTimer.BeginPhase(FT_PHASE_CAMERA);
 	setCamera();
+	if (m_bFrameTiming) m_frameTimer.EndPhase(FT_PHASE_CAMERA);
 
 #ifdef CLIPPING
 	GLdouble eqn[4] = {0.0, 0.0,-1.0, 0.0};    /* z < 0 */
@@ -313,9 +371,25 @@ void GLK::refresh()
     doDisplay();
 #endif
 
+	if (m_bFrameTiming && m_bFrameStatsDisp) m_frameTimer.DrawOverlay(m_SizeX,m_SizeY);
+
 	glPopMatrix();
 
+	if (m_bOffscreen) {
+		m_lastFrameDuration=glutGet(GLUT_ELAPSED_TIME)-m_lastFrameTime;
+		return;
+	}
+
+	if (m_bFrameTiming) {
+		m_frameTimer.EndGPUWork();
+		m_frameTimer.BeginPhase(FT_PHASE_SWAP);
+	}
     glutSwapBuffers();
+	if (m_bFrameTiming) {
+		m_frameTimer.EndPhase(FT_PHASE_SWAP);
+		m_frameTimer.EndFrame();
+	}
+	m_lastFrameDuration=glutGet(GLUT_ELAPSED_TIME)-m_lastFrameTime;
 }
 
 void GLK::setCamera()
@@ -337,18 +411,25 @@ void GLK::doDisplay()
 	//	The following lines are drawing axis.
 	if (m_axisDisplay) GLDrawAxis();
 
+	////////////////////////////////////////////////////////////////
+	//	The matrices of this frame, before the objects are drawn so
+	//	that they can cull against the view
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelMatrix);
+	glGetDoublev(GL_PROJECTION_MATRIX, projMatrix);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
 	////////////////////////////////////////////////////////////////
 	//	The following lines are drawing Object.
 	//		Default rendering 
+	if (m_bFrameTiming) m_frameTimer.BeginPhase(FT_PHASE_OBJLIST);
 	GLDrawDisplayObjList();
+	if (m_bFrameTiming) m_frameTimer.EndPhase(FT_PHASE_OBJLIST);
 
 	////////////////////////////////////////////////////////////////
 	//	The following lines are drawing GLList.
+	if (m_bFrameTiming) m_frameTimer.BeginPhase(FT_PHASE_GLLIST);
 	GLDrawGLList();
-
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelMatrix);
-	glGetDoublev(GL_PROJECTION_MATRIX, projMatrix);
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (m_bFrameTiming) m_frameTimer.EndPhase(FT_PHASE_GLLIST);
 
 /*	GLEnableLight();
 	glColor3f(1.0f,0.0f,0.0f);
@@ -359,7 +440,9 @@ void GLK::doDisplay()
 
 	////////////////////////////////////////////////////////////////
 	//	The following lines are drawing coordinate.
+	if (m_bFrameTiming) m_frameTimer.BeginPhase(FT_PHASE_COORDINATE);
 	GLDrawCoordinate();
+	if (m_bFrameTiming) m_frameTimer.EndPhase(FT_PHASE_COORDINATE);
 }
 
 void GLK::initValue()
@@ -431,7 +514,12 @@ void GLK::GLDrawCoordinate()
 		char text[256];
 		char *p;
 
-		sprintf(text,"(%.2f, %.2f, %.2f)",m_currentCoord[0],m_currentCoord[1],m_currentCoord[2]);
+		if (m_currentPntIndex>=0)
+			sprintf(text,"#%d (%.2f, %.2f, %.2f) n(%.2f, %.2f, %.2f)",m_currentPntIndex,
+				m_currentCoord[0],m_currentCoord[1],m_currentCoord[2],
+				m_currentNormal[0],m_currentNormal[1],m_currentNormal[2]);
+		else
+			sprintf(text,"(%.2f, %.2f, %.2f)",m_currentCoord[0],m_currentCoord[1],m_currentCoord[2]);
 
 		glLoadIdentity();
 		if (m_SizeX>m_SizeY)
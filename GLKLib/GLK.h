@@ -16,6 +16,7 @@
 #endif
 
 #include "GLKObList.h"
+#include "GLKFrameTimer.h"
 
 /////////////////////////////////////////////////////////////////////////////
 //	The following IDs are for the view direction
@@ -149,6 +150,11 @@ public:
 	//	The coornidate mapping between screen & wcl
 	void screen_to_wcl(double sx, double sy, double &cx, double &cy, double &cz);
 	void wcl_to_screen(double cx, double cy, double cz, double &sx, double &sy);
+
+	////////////////////////////////////////////////////////////
+	//	The view ray through a screen position, from the near plane
+	//		into the scene (the direction is normalized)
+	void screen_to_ray(double sx, double sy, double origin[], double dir[]);
 	
 	////////////////////////////////////////////////////////////
 	//	Add display objects into the display object list
@@ -183,6 +189,52 @@ public:
 
 	float GetRange() {return m_Range;};
 
+	////////////////////////////////////////////////////////////
+	//	Frame-time statistics: the CPU time of the phases of refresh
+	//	and the GPU time of the frame, shown as an overlay and/or
+	//	written as CSV rows to a trace file (NULL to stop tracing;
+	//	set at start-up from the PNTWORKS_FRAME_TRACE variable)
+	void SetFrameStatsDisplay(bool bDisp) {m_bFrameStatsDisp=bDisp;};
+	bool GetFrameStatsDisplay() {return m_bFrameStatsDisp;};
+	bool SetFrameTraceFile(const char *filename);
+
+	////////////////////////////////////////////////////////////
+	//	Redraw on demand: Invalidate only marks the view to be drawn
+	//	again, and RefreshIfInvalid (called when idle) draws it if at
+	//	least the frame interval has passed since the last frame, so
+	//	a burst of events is drawn as a single frame
+	//		bInteractive - the view is changed by a drag, and may be
+	//				drawn coarsely until no such change came for the
+	//				settle time; it is then drawn again at full quality
+	void Invalidate(bool bInteractive=false);
+	bool IsInvalid() {return m_bInvalid;};
+	bool IsInteracting() {return m_bInteracting;};
+	//	A frame which has to be complete (e.g. a snapshot) is drawn as not interacting
+	void SetInteracting(bool bInteracting) {m_bInteracting=bInteracting;};
+	bool RefreshIfInvalid();
+	//	In milliseconds, one refresh of a 60Hz display by default
+	void SetFrameInterval(int ms) {m_frameInterval=(ms<0)?0:ms;};
+	int GetFrameInterval() {return m_frameInterval;};
+	void SetSettleTime(int ms) {m_settleTime=(ms<0)?0:ms;};
+	int GetSettleTime() {return m_settleTime;};
+	//	The time taken by the last refresh, in milliseconds
+	int GetLastFrameDuration() {return m_lastFrameDuration;};
+
+	////////////////////////////////////////////////////////////
+	//	Offscreen: refresh draws into the framebuffer bound at the
+	//	time, e.g. of a GLKOffscreenContext, without the frame
+	//	statistics and without swapping buffers, so the frame can
+	//	be read back
+	void SetOffscreen(bool bOffscreen) {m_bOffscreen=bOffscreen;};
+	bool IsOffscreen() {return m_bOffscreen;};
+
+	////////////////////////////////////////////////////////////
+	//	The modelview and projection matrices (column-major) and
+	//	the viewport of the frame being drawn
+	const GLdouble* GetModelViewMatrix() {return modelMatrix;};
+	const GLdouble* GetProjectionMatrix() {return projMatrix;};
+	const GLint* GetViewport() {return viewport;};
+
 public:
 	short m_mouseState;	//	0 - nothing;
 						//	1 - left button
@@ -190,6 +242,8 @@ public:
 						//	3 - right button
 	bool m_bCoordDisp;	//	whether display coordinate value or not
 	float m_currentCoord[3];
+	int m_currentPntIndex;	//	index of the point under the cursor, -1 if none
+	float m_currentNormal[3];
 	short m_nModifier;	// 0 - nothing
 						// 1 - if the Shift modifier or Caps Lock is active
 						// 2 - if the Ctrl modifier is active
@@ -203,6 +257,15 @@ private:
 	GLdouble projMatrix[16];
 	GLint viewport[4];
 
+	GLKFrameTimer m_frameTimer;
+	bool m_bFrameStatsDisp, m_bFrameTrace;
+	bool m_bFrameTiming;	// whether the current frame is timed
+
+	bool m_bOffscreen;
+	bool m_bInvalid, m_bInteracting;
+	int m_frameInterval, m_lastFrameTime, m_lastFrameDuration;
+	int m_settleTime, m_lastInteractionTime;
+
 private:
 	void initValue();
 	void setCamera();
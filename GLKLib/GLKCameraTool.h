@@ -53,7 +53,7 @@ public:
 						pView->SetRotation(xR,yR);
 						oldX=pe.x;	oldY=pe.y;
 
-						pView->refresh();
+						pView->Invalidate(true);
 					}
 					if ((even_type==MOUSE_BUTTON_DOWN) && (pe.nFlags==GLUT_LEFT_BUTTON) && (pView->m_nModifier==1))
 					{	oldX=pe.x;	oldY=pe.y;	}
@@ -68,7 +68,7 @@ public:
 						pView->SetTranslation(xR,yR,zR);
 						oldX=pe.x;	oldY=pe.y;
 
-						pView->refresh();
+						pView->Invalidate(true);
 					}
 					if (even_type==KEY_PRESS)
 					{
@@ -77,28 +77,28 @@ public:
 							float xR,yR;
 							pView->GetRotation(xR,yR);
 							pView->SetRotation(xR,yR-10);
-							pView->refresh();
+							pView->Invalidate();
 						}
 						if (pe.nChar==-GLUT_KEY_RIGHT)	//	RIGHT_KEY
 						{
 							float xR,yR;
 							pView->GetRotation(xR,yR);
 							pView->SetRotation(xR,yR+10);
-							pView->refresh();
+							pView->Invalidate();
 						}
 						if (pe.nChar==-GLUT_KEY_UP)	//	UP_KEY
 						{
 							float xR,yR;
 							pView->GetRotation(xR,yR);
 							pView->SetRotation(xR-10,yR);
-							pView->refresh();
+							pView->Invalidate();
 						}
 						if (pe.nChar==-GLUT_KEY_DOWN)	//	DOWN_KEY
 						{
 							float xR,yR;
 							pView->GetRotation(xR,yR);
 							pView->SetRotation(xR+10,yR);
-							pView->refresh();
+							pView->Invalidate();
 						}
 					}
 				   }break;
@@ -124,7 +124,7 @@ public:
 						pView->SetRotation(xR,yR);
 						oldX=pe.x;	oldY=pe.y;
 
-						pView->refresh();
+						pView->Invalidate(true);
 					}
 				   }break;
 		case PAN:  {
@@ -141,7 +141,7 @@ public:
 						pView->SetTranslation(xR,yR,zR);
 						oldX=pe.x;	oldY=pe.y;
 
-						pView->refresh();
+						pView->Invalidate(true);
 					}
 				   }break;
 		case ZOOM: {
@@ -156,7 +156,7 @@ public:
 						if (scale<0.0001) scale=0.0001f;
 						pView->SetScale(scale);
 						oldY=pe.y;
-						pView->refresh();
+						pView->Invalidate(true);
 					}
 					if (even_type==MOUSE_BUTTON_UP) m_ct=ORBITPAN;
 				   }break;
@@ -204,7 +204,7 @@ public:
 							pView->SetTranslation(xR,yR,zR);
 
 							pView->Reshape(sx,sy);
-							pView->refresh();
+							pView->Invalidate();
 							m_ct=ORBITPAN;
 						}
 					}
@@ -0,0 +1,203 @@
+// GLKFrameTimer.cpp: implementation of the GLKFrameTimer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#if defined(__APPLE__)
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "GLKFrameTimer.h"
+
+static const char *_phaseNames[FT_PHASE_NUM]={"camera","objects","gllist","coordinate","swap"};
+
+static double _nowInMs()
+{
+	return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLKFrameTimer::GLKFrameTimer()
+{
+	m_frameIndex=0;		m_frameBegin=0.0;
+	memset(m_phaseBegin,0,sizeof(m_phaseBegin));
+	memset(&m_current,0,sizeof(m_current));
+	m_bGPUTiming=false;		m_gpuCurrent=-1;
+	for(int i=0;i<FT_GPU_QUERY_NUM;i++) {m_gpuQueries[i]=0; m_gpuInFlight[i]=false;}
+	m_traceFile=NULL;
+}
+
+GLKFrameTimer::~GLKFrameTimer()
+{
+	SetTraceFile(NULL);
+	//	the queries go with the GL context
+}
+
+bool GLKFrameTimer::SetTraceFile(const char *filename)
+{
+	if (m_traceFile!=NULL) {
+		if (m_bGPUTiming) _collectGPUResults(true);
+		fclose(m_traceFile);	m_traceFile=NULL;
+	}
+	if (filename==NULL) return true;
+
+	m_traceFile=fopen(filename,"w");
+	if (m_traceFile==NULL) {printf("Can not open the frame trace file %s!\n",filename); return false;}
+	fprintf(m_traceFile,"frame");
+	for(int i=0;i<FT_PHASE_NUM;i++) fprintf(m_traceFile,",%s_ms",_phaseNames[i]);
+	fprintf(m_traceFile,",cpu_ms,gpu_ms\n");
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Timing
+//////////////////////////////////////////////////////////////////////
+
+void GLKFrameTimer::BeginFrame()
+{
+	memset(&m_current,0,sizeof(m_current));
+	m_current.frameIndex=m_frameIndex++;
+	m_frameBegin=_nowInMs();
+
+	//	GLEW is initialized after the first frames, until then there are no queries
+	if (!m_bGPUTiming && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query)) {
+		glGenQueries(FT_GPU_QUERY_NUM,m_gpuQueries);
+		m_bGPUTiming=true;
+	}
+	m_gpuCurrent=-1;
+	if (!m_bGPUTiming) return;
+
+	_collectGPUResults(false);
+	for(int i=0;i<FT_GPU_QUERY_NUM;i++) {
+		if (m_gpuInFlight[i]) continue;
+		m_gpuCurrent=i;
+		glBeginQuery(GL_TIME_ELAPSED,m_gpuQueries[i]);
+		break;
+	}
+}
+
+void GLKFrameTimer::BeginPhase(int phase)
+{
+	m_phaseBegin[phase]=_nowInMs();
+}
+
+void GLKFrameTimer::EndPhase(int phase)
+{
+	m_current.phaseTime[phase]+=_nowInMs()-m_phaseBegin[phase];
+}
+
+void GLKFrameTimer::EndGPUWork()
+{
+	if (m_gpuCurrent<0) return;
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GLKFrameTimer::EndFrame()
+{
+	m_current.cpuTime=_nowInMs()-m_frameBegin;
+	for(int i=0;i<FT_PHASE_NUM;i++) m_phaseWindow[i].Add(m_current.phaseTime[i]);
+	m_cpuWindow.Add(m_current.cpuTime);
+
+	if (m_gpuCurrent>=0) {
+		//	the row is written once the GPU time is known
+		m_gpuPending[m_gpuCurrent]=m_current;	m_gpuInFlight[m_gpuCurrent]=true;
+		m_gpuCurrent=-1;
+	}
+	else
+		_writeTraceRow(m_current,-1.0);
+}
+
+void GLKFrameTimer::_collectGPUResults(bool bWait)
+{
+	for(int i=0;i<FT_GPU_QUERY_NUM;i++) {
+		if (!m_gpuInFlight[i]) continue;
+		if (!bWait) {
+			GLuint available=0;
+			glGetQueryObjectuiv(m_gpuQueries[i],GL_QUERY_RESULT_AVAILABLE,&available);
+			if (!available) continue;
+		}
+		GLuint64 elapsed=0;
+		glGetQueryObjectui64v(m_gpuQueries[i],GL_QUERY_RESULT,&elapsed);
+		m_gpuInFlight[i]=false;
+		double gpuTime=(double)elapsed*1.0e-6;
+		m_gpuWindow.Add(gpuTime);
+		_writeTraceRow(m_gpuPending[i],gpuTime);
+	}
+}
+
+void GLKFrameTimer::_writeTraceRow(const FrameSample &sample, double gpuTime)
+{
+	if (m_traceFile==NULL) return;
+	fprintf(m_traceFile,"%d",sample.frameIndex);
+	for(int i=0;i<FT_PHASE_NUM;i++) fprintf(m_traceFile,",%.3f",sample.phaseTime[i]);
+	fprintf(m_traceFile,",%.3f,",sample.cpuTime);
+	if (gpuTime>=0.0) fprintf(m_traceFile,"%.3f",gpuTime);
+	fprintf(m_traceFile,"\n");
+}
+
+//////////////////////////////////////////////////////////////////////
+// Statistics
+//////////////////////////////////////////////////////////////////////
+
+void GLKFrameTimer::RollingWindow::Add(double value)
+{
+	if ((int)values.size()<FT_WINDOW_SIZE)
+		values.push_back(value);
+	else {
+		values[next]=value;		next=(next+1)%FT_WINDOW_SIZE;
+	}
+}
+
+bool GLKFrameTimer::RollingWindow::Percentiles(double &p50, double &p95, double &p99) const
+{
+	if (values.empty()) return false;
+	std::vector<double> sorted(values);
+	std::sort(sorted.begin(),sorted.end());
+	int n=(int)sorted.size();
+	p50=sorted[(n-1)*50/100];	p95=sorted[(n-1)*95/100];	p99=sorted[(n-1)*99/100];
+	return true;
+}
+
+void GLKFrameTimer::DrawOverlay(int sizeX, int sizeY)
+{
+	char lines[FT_PHASE_NUM+3][128];	int lineNum=0;
+	double p50,p95,p99;
+	sprintf(lines[lineNum++],"%-11s %7s %7s %7s","ms","p50","p95","p99");
+	for(int i=0;i<FT_PHASE_NUM;i++) {
+		if (!m_phaseWindow[i].Percentiles(p50,p95,p99)) continue;
+		sprintf(lines[lineNum++],"%-11s %7.2f %7.2f %7.2f",_phaseNames[i],p50,p95,p99);
+	}
+	if (m_cpuWindow.Percentiles(p50,p95,p99))
+		sprintf(lines[lineNum++],"%-11s %7.2f %7.2f %7.2f","cpu total",p50,p95,p99);
+	if (m_gpuWindow.Percentiles(p50,p95,p99))
+		sprintf(lines[lineNum++],"%-11s %7.2f %7.2f %7.2f","gpu",p50,p95,p99);
+	else
+		sprintf(lines[lineNum++],"%-11s %7s","gpu","n/a");
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);		glDisable(GL_DEPTH_TEST);
+	glMatrixMode(GL_PROJECTION);	glPushMatrix();		glLoadIdentity();
+	glOrtho(0,sizeX,0,sizeY,-1,1);
+	glMatrixMode(GL_MODELVIEW);		glPushMatrix();		glLoadIdentity();
+
+	glColor3f(1.0f,1.0f,0.0f);
+	for(int i=0;i<lineNum;i++) {
+		glRasterPos2i(8,sizeY-18-i*15);
+		for(const char *p=lines[i];*p;p++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13,*p);
+	}
+
+	glMatrixMode(GL_MODELVIEW);		glPopMatrix();
+	glMatrixMode(GL_PROJECTION);	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
@@ -0,0 +1,78 @@
+// GLKFrameTimer.h: interface for the GLKFrameTimer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _CW_GLKFRAMETIMER
+#define _CW_GLKFRAMETIMER
+
+#include <stdio.h>
+#include <vector>
+
+#define FT_PHASE_CAMERA			0
+#define FT_PHASE_OBJLIST		1
+#define FT_PHASE_GLLIST			2
+#define FT_PHASE_COORDINATE		3
+#define FT_PHASE_SWAP			4
+#define FT_PHASE_NUM			5
+
+#define FT_WINDOW_SIZE			240		// frames kept for the percentiles
+#define FT_GPU_QUERY_NUM		4		// frames the GPU timing may lag behind
+
+//	Times the phases of a frame on the CPU, and the whole frame on the GPU by
+//	timer queries. A query is only read once its result is available, a few
+//	frames later, so timing never waits for the GPU; while all queries are in
+//	flight a frame goes without GPU time. The times of the last frames are
+//	shown as percentiles by DrawOverlay, and can be written as CSV rows.
+class GLKFrameTimer
+{
+public:
+	GLKFrameTimer();
+	virtual ~GLKFrameTimer();
+
+	void BeginFrame();
+	void BeginPhase(int phase);
+	void EndPhase(int phase);
+	//	The end of the GL commands timed on the GPU (before the swap)
+	void EndGPUWork();
+	void EndFrame();
+
+	//	Draw the percentiles at the top-left corner of a window of sizeX x sizeY
+	void DrawOverlay(int sizeX, int sizeY);
+
+	//	Write a CSV row per frame to filename, none if NULL
+	bool SetTraceFile(const char *filename);
+
+private:
+	struct FrameSample {
+		int frameIndex;
+		double phaseTime[FT_PHASE_NUM], cpuTime;	// milliseconds
+	};
+
+	struct RollingWindow {
+		std::vector<double> values;
+		int next;
+		RollingWindow() {next=0;};
+		void Add(double value);
+		//	false if empty
+		bool Percentiles(double &p50, double &p95, double &p99) const;
+	};
+
+	void _collectGPUResults(bool bWait);
+	void _writeTraceRow(const FrameSample &sample, double gpuTime);
+
+	int m_frameIndex;
+	double m_frameBegin, m_phaseBegin[FT_PHASE_NUM];
+	FrameSample m_current;
+
+	RollingWindow m_phaseWindow[FT_PHASE_NUM], m_cpuWindow, m_gpuWindow;
+
+	bool m_bGPUTiming;
+	unsigned int m_gpuQueries[FT_GPU_QUERY_NUM];
+	FrameSample m_gpuPending[FT_GPU_QUERY_NUM];
+	bool m_gpuInFlight[FT_GPU_QUERY_NUM];
+	int m_gpuCurrent;		// the query of this frame, -1 if none
+
+	FILE *m_traceFile;
+};
+
+#endif
@@ -0,0 +1,143 @@
+// GLKIndexGraph.cpp: implementation of the GLKIndexGraph class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include "GLKIndexGraph.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLKIndexGraph::GLKIndexGraph(int nodeNum)
+{
+	m_nodeNum=nodeNum;
+}
+
+GLKIndexGraph::~GLKIndexGraph()
+{
+}
+
+void GLKIndexGraph::AddEdge(int startNode, int endNode, float weight)
+{
+	Edge edge;
+	edge.startNode=startNode;	edge.endNode=endNode;	edge.weight=(weight>0.0f)?weight:0.0f;
+	m_edges.push_back(edge);
+}
+
+void GLKIndexGraph::SetEdgeNum(size_t edgeNum)
+{
+	m_edges.resize(edgeNum);
+}
+
+void GLKIndexGraph::SetEdge(size_t edgeIndex, int startNode, int endNode, float weight)
+{
+	Edge &edge=m_edges[edgeIndex];
+	edge.startNode=startNode;	edge.endNode=endNode;	edge.weight=(weight>0.0f)?weight:0.0f;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Minimum spanning tree
+//////////////////////////////////////////////////////////////////////
+
+double GLKIndexGraph::MinimumSpanningTree(int rootNode, int *parentNode, int *visitOrder)
+{
+	int i,j;	size_t e,edgeNum=m_edges.size();	double cost=0.0;
+
+	//--------------------------------------------------------------------------------
+	//	Kruskal: take the edges by increasing weight, keep those joining two trees
+	_sortEdgesByWeight();
+	std::vector<int> setParent(m_nodeNum), setSize(m_nodeNum,1);
+	for(i=0;i<m_nodeNum;i++) setParent[i]=i;
+	std::vector<size_t> treeEdges;	treeEdges.reserve(m_nodeNum);
+	for(e=0;e<edgeNum && (int)treeEdges.size()<m_nodeNum-1;e++) {
+		int r1=_findRoot(&setParent[0],m_edges[e].startNode);
+		int r2=_findRoot(&setParent[0],m_edges[e].endNode);
+		if (r1==r2) continue;
+		if (setSize[r1]<setSize[r2]) {int tmp=r1; r1=r2; r2=tmp;}
+		setParent[r2]=r1;	setSize[r1]+=setSize[r2];
+		treeEdges.push_back(e);		cost+=m_edges[e].weight;
+	}
+
+	//--------------------------------------------------------------------------------
+	//	Adjacency of the forest in compressed rows
+	std::vector<int> adjBegin(m_nodeNum+1,0), adjNode(treeEdges.size()*2);
+	for(i=0;i<(int)treeEdges.size();i++) {
+		adjBegin[m_edges[treeEdges[i]].startNode+1]++;	adjBegin[m_edges[treeEdges[i]].endNode+1]++;
+	}
+	for(i=0;i<m_nodeNum;i++) adjBegin[i+1]+=adjBegin[i];
+	std::vector<int> adjFill(adjBegin.begin(),adjBegin.end()-1);
+	for(i=0;i<(int)treeEdges.size();i++) {
+		const Edge &edge=m_edges[treeEdges[i]];
+		adjNode[adjFill[edge.startNode]++]=edge.endNode;
+		adjNode[adjFill[edge.endNode]++]=edge.startNode;
+	}
+
+	//--------------------------------------------------------------------------------
+	//	Breadth-first traversal, visitOrder doubles as the queue
+	for(i=0;i<m_nodeNum;i++) parentNode[i]=-2;	// -2: not visited yet
+	int visitedNum=0,nextRoot=0;
+	while(visitedNum<m_nodeNum) {
+		int root;
+		if (visitedNum==0 && rootNode>=0 && rootNode<m_nodeNum)
+			root=rootNode;
+		else {
+			while(parentNode[nextRoot]!=-2) nextRoot++;
+			root=nextRoot;
+		}
+		parentNode[root]=-1;	visitOrder[visitedNum++]=root;
+		for(int head=visitedNum-1;head<visitedNum;head++) {
+			int node=visitOrder[head];
+			for(j=adjBegin[node];j<adjBegin[node+1];j++) {
+				int linkedNode=adjNode[j];
+				if (parentNode[linkedNode]!=-2) continue;
+				parentNode[linkedNode]=node;	visitOrder[visitedNum++]=linkedNode;
+			}
+		}
+	}
+
+	return cost;
+}
+
+int GLKIndexGraph::_findRoot(int *setParent, int node)
+{
+	while(setParent[node]!=node) {
+		setParent[node]=setParent[setParent[node]];		// path halving
+		node=setParent[node];
+	}
+	return node;
+}
+
+void GLKIndexGraph::_sortEdgesByWeight()
+{
+	//	The bit patterns of non-negative floats sort like the floats themselves, so an
+	//	LSD radix sort on the 32 bits (three passes of 11 bits) orders the edges stably
+	const int digitBits=11,bucketNum=1<<digitBits;
+	size_t edgeNum=m_edges.size();
+	if (edgeNum<2) return;
+
+	std::vector<Edge> buffer(edgeNum);
+	Edge *src=&m_edges[0],*dst=&buffer[0];
+	std::vector<size_t> bucketBegin(bucketNum);
+	for(int shift=0;shift<32;shift+=digitBits) {
+		memset(&bucketBegin[0],0,sizeof(size_t)*bucketNum);
+		for(size_t i=0;i<edgeNum;i++) {
+			unsigned int key;	memcpy(&key,&(src[i].weight),sizeof(key));
+			bucketBegin[(key>>shift)&(bucketNum-1)]++;
+		}
+		//	Skip the pass when all edges share the digit
+		bool bAllInOne=false;
+		for(int b=0;b<bucketNum;b++) {if (bucketBegin[b]==edgeNum) {bAllInOne=true; break;}}
+		if (bAllInOne) continue;
+
+		size_t sum=0;
+		for(int b=0;b<bucketNum;b++) {size_t count=bucketBegin[b]; bucketBegin[b]=sum; sum+=count;}
+		for(size_t i=0;i<edgeNum;i++) {
+			unsigned int key;	memcpy(&key,&(src[i].weight),sizeof(key));
+			dst[bucketBegin[(key>>shift)&(bucketNum-1)]++]=src[i];
+		}
+		Edge *tmp=src; src=dst; dst=tmp;
+	}
+	if (src!=&m_edges[0]) memcpy(&m_edges[0],src,sizeof(Edge)*edgeNum);
+}
@@ -0,0 +1,56 @@
+// GLKIndexGraph.h: interface for the GLKIndexGraph class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _CW_GLKINDEXGRAPH
+#define _CW_GLKINDEXGRAPH
+
+#include <stddef.h>
+#include <vector>
+
+//	A compact weighted graph on the nodes 0..nodeNum-1 which are only
+//	referred to by index. Unlike GLKGraph no object is allocated per node
+//	or edge: the edges are kept in flat arrays, so graphs with tens of
+//	millions of edges (e.g. the k-nearest-neighbor graph of a point cloud)
+//	fit into memory. Edges are counted in size_t, as a kNN graph of a large
+//	cloud can have more edges than an int holds.
+class GLKIndexGraph
+{
+public:
+	GLKIndexGraph(int nodeNum);
+	virtual ~GLKIndexGraph();
+
+	int GetNodeNum() {return m_nodeNum;};
+	size_t GetEdgeNum() {return m_edges.size();};
+
+	void AddEdge(int startNode, int endNode, float weight);
+	//	Resize the edge array, after which the edges can be filled in by SetEdge
+	//	from several threads at once (each thread on its own indices)
+	void SetEdgeNum(size_t edgeNum);
+	void SetEdge(size_t edgeIndex, int startNode, int endNode, float weight);
+
+public:
+	//-------------------------------------------------------------------------------
+	//	The following function is implemented by the Kruskal's algorithm with the edges
+	//	sorted by a radix sort on the (non-negative) weights, followed by a breadth-first
+	//	traversal of the spanning forest. The tree containing rootNode is traversed first,
+	//	every further tree from its node of lowest index.
+	//		parentNode[i] - the parent of node i on the tree, -1 for the roots
+	//		visitOrder - all nodes, every parent before its children
+	//	Returns the total weight of the spanning forest.
+	double MinimumSpanningTree(int rootNode, int *parentNode, int *visitOrder);
+
+private:
+	struct Edge {
+		int startNode, endNode;
+		float weight;
+	};
+
+	void _sortEdgesByWeight();
+	int _findRoot(int *setParent, int node);
+
+	int m_nodeNum;
+	std::vector<Edge> m_edges;
+};
+
+#endif
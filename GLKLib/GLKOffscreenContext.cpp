@@ -0,0 +1,162 @@
+// GLKOffscreenContext.cpp: implementation of the GLKOffscreenContext class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#include <stdio.h>
+
+#if defined(PNTWORKS_WITH_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "GLKOffscreenContext.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLKOffscreenContext::GLKOffscreenContext()
+{
+	m_width=m_height=0;
+	m_context=NULL;		m_display=NULL;
+	m_fbo=m_colorRenderbuffer=m_depthRenderbuffer=0;
+}
+
+GLKOffscreenContext::~GLKOffscreenContext()
+{
+	Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+//////////////////////////////////////////////////////////////////////
+
+const char* GLKOffscreenContext::GetBackendName()
+{
+#if defined(PNTWORKS_WITH_EGL)
+	return "EGL";
+#else
+	return NULL;
+#endif
+}
+
+bool GLKOffscreenContext::Create(int width, int height)
+{
+	Destroy();
+	if (width<=0 || height<=0) return false;
+	m_width=width;	m_height=height;
+
+#if defined(PNTWORKS_WITH_EGL)
+	//	Prefer the first GPU as a device display, which needs no X or Wayland server
+	EGLDisplay display=EGL_NO_DISPLAY;
+	PFNEGLQUERYDEVICESEXTPROC queryDevices=(PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay=
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (queryDevices!=NULL && getPlatformDisplay!=NULL) {
+		EGLDeviceEXT device;	EGLint deviceNum=0;
+		if (queryDevices(1,&device,&deviceNum) && deviceNum>0)
+			display=getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT,device,NULL);
+	}
+	if (display==EGL_NO_DISPLAY) display=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display==EGL_NO_DISPLAY || !eglInitialize(display,NULL,NULL)) {
+		printf("EGL display could not be initialized!\n");	return false;
+	}
+	m_display=(void*)display;
+
+	static const EGLint configAttribs[]={
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,	EGL_GREEN_SIZE, 8,	EGL_BLUE_SIZE, 8,	EGL_DEPTH_SIZE, 24,
+		EGL_NONE};
+	EGLConfig config;	EGLint configNum=0;
+	if (!eglChooseConfig(display,configAttribs,&config,1,&configNum) || configNum==0 || !eglBindAPI(EGL_OPENGL_API)) {
+		printf("EGL has no configuration for desktop OpenGL!\n");	Destroy();	return false;
+	}
+	EGLContext context=eglCreateContext(display,config,EGL_NO_CONTEXT,NULL);
+	if (context==EGL_NO_CONTEXT) {printf("EGL context could not be created!\n");	Destroy();	return false;}
+	m_context=(void*)context;
+	if (!MakeCurrent()) {
+		printf("EGL context could not be made current without a surface (EGL_KHR_surfaceless_context)!\n");
+		Destroy();	return false;
+	}
+	if (!_initGLEW() || !_createFramebuffer()) {Destroy();	return false;}
+	return true;
+#else
+	printf("No offscreen rendering: build with PNTWORKS_WITH_EGL!\n");
+	return false;
+#endif
+}
+
+void GLKOffscreenContext::Destroy()
+{
+	if (m_context!=NULL && m_fbo!=0) {
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glDeleteFramebuffers(1,&m_fbo);
+		glDeleteRenderbuffers(1,&m_colorRenderbuffer);
+		glDeleteRenderbuffers(1,&m_depthRenderbuffer);
+	}
+	m_fbo=m_colorRenderbuffer=m_depthRenderbuffer=0;
+
+#if defined(PNTWORKS_WITH_EGL)
+	if (m_display!=NULL) {
+		eglMakeCurrent((EGLDisplay)m_display,EGL_NO_SURFACE,EGL_NO_SURFACE,EGL_NO_CONTEXT);
+		if (m_context!=NULL) eglDestroyContext((EGLDisplay)m_display,(EGLContext)m_context);
+		eglTerminate((EGLDisplay)m_display);
+	}
+#endif
+	m_context=NULL;		m_display=NULL;
+}
+
+bool GLKOffscreenContext::MakeCurrent()
+{
+	if (m_context==NULL) return false;
+#if defined(PNTWORKS_WITH_EGL)
+	if (!eglMakeCurrent((EGLDisplay)m_display,EGL_NO_SURFACE,EGL_NO_SURFACE,(EGLContext)m_context)) return false;
+	if (m_fbo!=0) glBindFramebuffer(GL_FRAMEBUFFER,m_fbo);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool GLKOffscreenContext::_initGLEW()
+{
+	//	GLEW built for GLX loads the GL functions first and fails on looking for an X
+	//	display afterwards; that is only ignored once the functions used here are there
+	glewExperimental=GL_TRUE;
+	GLenum error=glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	if (error==GLEW_ERROR_NO_GLX_DISPLAY) {
+		if (glGetString(GL_VERSION)==NULL || glGenFramebuffers==NULL || glGenBuffers==NULL) {
+			printf("glewInit found no X display and did not load the GL functions!\n");	return false;
+		}
+		error=GLEW_OK;
+	}
+#endif
+	if (error!=GLEW_OK) {printf("glewInit failed: %s\n",(const char*)glewGetErrorString(error));	return false;}
+	return true;
+}
+
+bool GLKOffscreenContext::_createFramebuffer()
+{
+	if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+		printf("Framebuffer objects are not supported!\n");	return false;
+	}
+	glGenRenderbuffers(1,&m_colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER,m_colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,m_width,m_height);
+	glGenRenderbuffers(1,&m_depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER,m_depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH24_STENCIL8,m_width,m_height);
+	glBindRenderbuffer(GL_RENDERBUFFER,0);
+
+	glGenFramebuffers(1,&m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER,m_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,m_colorRenderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_STENCIL_ATTACHMENT,GL_RENDERBUFFER,m_depthRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE) {
+		printf("The offscreen framebuffer is incomplete!\n");	return false;
+	}
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);		glReadBuffer(GL_COLOR_ATTACHMENT0);
+	return true;
+}
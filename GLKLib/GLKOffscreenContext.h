@@ -0,0 +1,38 @@
+// GLKOffscreenContext.h: interface for the GLKOffscreenContext class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _CW_GLKOFFSCREENCONTEXT
+#define _CW_GLKOFFSCREENCONTEXT
+
+//	A GL context without any window, for rendering on machines with no
+//	display. It is created by EGL without a surface (PNTWORKS_WITH_EGL);
+//	the scene is drawn into a framebuffer of the given size, which stays
+//	bound for drawing and reading. GLEW is initialized on creation.
+class GLKOffscreenContext
+{
+public:
+	GLKOffscreenContext();
+	virtual ~GLKOffscreenContext();
+
+	//	False if no backend was built in or the context could not be
+	//	created, with the reason printed
+	bool Create(int width, int height);
+	void Destroy();
+	bool MakeCurrent();
+
+	int GetWidth() {return m_width;};
+	int GetHeight() {return m_height;};
+	//	"EGL", or NULL when it was not built in
+	static const char* GetBackendName();
+
+private:
+	int m_width, m_height;
+	void *m_context, *m_display;
+	unsigned int m_fbo, m_colorRenderbuffer, m_depthRenderbuffer;
+
+	bool _initGLEW();
+	bool _createFramebuffer();
+};
+
+#endif
@@ -0,0 +1,126 @@
+// GLKShaderProgram.cpp: implementation of the GLKShaderProgram class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#include <stdio.h>
+#include <vector>
+
+#include "GLKShaderProgram.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLKShaderProgram::GLKShaderProgram()
+{
+	m_programID=0;	m_bLinked=false;
+}
+
+GLKShaderProgram::~GLKShaderProgram()
+{
+	ClearAll();
+}
+
+void GLKShaderProgram::ClearAll()
+{
+	for(int i=0;i<(int)m_shaderIDs.size();i++) glDeleteShader(m_shaderIDs[i]);
+	m_shaderIDs.clear();
+	if (m_programID!=0) {glDeleteProgram(m_programID); m_programID=0;}
+	m_bLinked=false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Building
+//////////////////////////////////////////////////////////////////////
+
+bool GLKShaderProgram::AddShader(unsigned int shaderType, const char *source)
+{
+	if (m_programID==0) m_programID=glCreateProgram();
+	if (m_programID==0) return false;
+
+	GLuint shaderID=glCreateShader(shaderType);
+	if (shaderID==0) return false;
+	glShaderSource(shaderID,1,&source,NULL);
+	glCompileShader(shaderID);
+
+	GLint status=GL_FALSE;
+	glGetShaderiv(shaderID,GL_COMPILE_STATUS,&status);
+	if (status!=GL_TRUE) {
+		GLint logLength=0;
+		glGetShaderiv(shaderID,GL_INFO_LOG_LENGTH,&logLength);
+		std::vector<char> log(logLength+1,0);
+		if (logLength>0) glGetShaderInfoLog(shaderID,logLength,NULL,&log[0]);
+		printf("Shader compilation failed:\n%s\n",&log[0]);
+		glDeleteShader(shaderID);
+		return false;
+	}
+	glAttachShader(m_programID,shaderID);
+	m_shaderIDs.push_back(shaderID);
+	return true;
+}
+
+bool GLKShaderProgram::Link()
+{
+	if (m_programID==0) return false;
+	glLinkProgram(m_programID);
+
+	GLint status=GL_FALSE;
+	glGetProgramiv(m_programID,GL_LINK_STATUS,&status);
+	if (status!=GL_TRUE) {
+		GLint logLength=0;
+		glGetProgramiv(m_programID,GL_INFO_LOG_LENGTH,&logLength);
+		std::vector<char> log(logLength+1,0);
+		if (logLength>0) glGetProgramInfoLog(m_programID,logLength,NULL,&log[0]);
+		printf("Shader program linking failed:\n%s\n",&log[0]);
+		m_bLinked=false;
+		return false;
+	}
+	m_bLinked=true;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Using
+//////////////////////////////////////////////////////////////////////
+
+void GLKShaderProgram::Use()
+{
+	if (m_bLinked) glUseProgram(m_programID);
+}
+
+void GLKShaderProgram::UseNone()
+{
+	glUseProgram(0);
+}
+
+int GLKShaderProgram::GetUniformLocation(const char *name)
+{
+	if (!m_bLinked) return -1;
+	return glGetUniformLocation(m_programID,name);
+}
+
+int GLKShaderProgram::GetAttribLocation(const char *name)
+{
+	if (!m_bLinked) return -1;
+	return glGetAttribLocation(m_programID,name);
+}
+
+//	The uniform setters act on the program in use
+void GLKShaderProgram::SetUniform1i(const char *name, int value)
+{
+	GLint location=GetUniformLocation(name);
+	if (location>=0) glUniform1i(location,value);
+}
+
+void GLKShaderProgram::SetUniform1f(const char *name, float value)
+{
+	GLint location=GetUniformLocation(name);
+	if (location>=0) glUniform1f(location,value);
+}
+
+void GLKShaderProgram::SetUniform2f(const char *name, float v0, float v1)
+{
+	GLint location=GetUniformLocation(name);
+	if (location>=0) glUniform2f(location,v0,v1);
+}
@@ -0,0 +1,47 @@
+// GLKShaderProgram.h: interface for the GLKShaderProgram class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _CW_GLKSHADERPROGRAM
+#define _CW_GLKSHADERPROGRAM
+
+#include <vector>
+
+//	A GLSL program built from shader sources. The GL types are kept out of
+//	this header (GLuint/GLenum are unsigned int), so it can be included after
+//	GLK.h without GLEW. All functions need a current GL context and an
+//	initialized GLEW.
+class GLKShaderProgram
+{
+public:
+	GLKShaderProgram();
+	virtual ~GLKShaderProgram();
+
+	//	Compile a shader of the given type (GL_VERTEX_SHADER, GL_GEOMETRY_SHADER,
+	//	GL_FRAGMENT_SHADER, ...) and attach it to the program; the info log is
+	//	printed when the compilation fails
+	bool AddShader(unsigned int shaderType, const char *source);
+	//	Link the attached shaders, printing the info log on failure
+	bool Link();
+	bool IsLinked() {return m_bLinked;};
+
+	void Use();
+	static void UseNone();
+
+	int GetUniformLocation(const char *name);
+	void SetUniform1i(const char *name, int value);
+	void SetUniform1f(const char *name, float value);
+	void SetUniform2f(const char *name, float v0, float v1);
+	int GetAttribLocation(const char *name);
+
+	unsigned int GetProgramID() {return m_programID;};
+
+	void ClearAll();
+
+private:
+	unsigned int m_programID;
+	std::vector<unsigned int> m_shaderIDs;
+	bool m_bLinked;
+};
+
+#endif
@@ -0,0 +1,184 @@
+// GLKSnapshotWriter.cpp: implementation of the GLKSnapshotWriter class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "GLKSnapshotWriter.h"
+
+#include "../utils/PngWriter.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLKSnapshotWriter::GLKSnapshotWriter(int encoderNum)
+{
+	for(int i=0;i<SNAPSHOT_PBO_NUM;i++) {
+		m_readbacks[i].pbo=0;	m_readbacks[i].size=0;
+		m_readbacks[i].fence=NULL;	m_readbacks[i].bBusy=false;
+	}
+	m_nextReadback=m_oldestReadback=m_busyNum=0;
+
+	m_runningJobNum=m_writtenNum=m_failedNum=0;	m_bStop=false;
+	if (encoderNum<=0) {
+		encoderNum=(int)std::thread::hardware_concurrency()/2;
+		if (encoderNum<1) encoderNum=1;
+	}
+	for(int i=0;i<encoderNum;i++) m_encoders.push_back(std::thread(&GLKSnapshotWriter::_encoderLoop,this));
+}
+
+GLKSnapshotWriter::~GLKSnapshotWriter()
+{
+	//	The readbacks still in flight need the GL context, which may be gone by now, so
+	//	only the queued images are finished here
+	{
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		m_bStop=true;
+	}
+	m_jobReady.notify_all();
+	for(size_t i=0;i<m_encoders.size();i++) m_encoders[i].join();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+//////////////////////////////////////////////////////////////////////
+
+void GLKSnapshotWriter::Capture(int width, int height, const char *filename)
+{
+	if (width<=0 || height<=0) return;
+	glPixelStorei(GL_PACK_ALIGNMENT,1);
+
+	if (!GLEW_VERSION_2_1 && !GLEW_ARB_pixel_buffer_object) {
+		EncodeJob *job=new EncodeJob;
+		job->pixels.resize((size_t)width*height*4);
+		glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,&(job->pixels[0]));
+		job->width=width;	job->height=height;	job->filename=filename;
+		_queueJob(job);
+		return;
+	}
+
+	if (m_busyNum==SNAPSHOT_PBO_NUM) _retireOldest(true);
+
+	Readback &readback=m_readbacks[m_nextReadback];
+	int size=width*height*4;
+	if (readback.pbo==0) glGenBuffers(1,&(readback.pbo));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,readback.pbo);
+	if (readback.size!=size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER,size,NULL,GL_STREAM_READ);
+		readback.size=size;
+	}
+	glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,(GLvoid*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	readback.fence=(GLEW_VERSION_3_2 || GLEW_ARB_sync) ? (void*)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0) : NULL;
+	readback.bBusy=true;
+	readback.width=width;	readback.height=height;	readback.filename=filename;
+
+	m_nextReadback=(m_nextReadback+1)%SNAPSHOT_PBO_NUM;		m_busyNum++;
+}
+
+void GLKSnapshotWriter::Poll()
+{
+	//	In the order of the captures; without sync objects there is no telling whether a
+	//	readback is done, so mapping its buffer may wait for the GPU
+	while(m_busyNum>0) {
+		if (!_retireOldest(false)) break;
+	}
+}
+
+void GLKSnapshotWriter::Flush()
+{
+	while(m_busyNum>0) _retireOldest(true);
+
+	std::unique_lock<std::mutex> lock(m_jobMutex);
+	while(!m_jobs.empty() || m_runningJobNum>0) m_jobDone.wait(lock);
+}
+
+void GLKSnapshotWriter::ClearAll()
+{
+	Flush();
+	for(int i=0;i<SNAPSHOT_PBO_NUM;i++) {
+		if (m_readbacks[i].pbo!=0) glDeleteBuffers(1,&(m_readbacks[i].pbo));
+		m_readbacks[i].pbo=0;	m_readbacks[i].size=0;
+	}
+	m_nextReadback=m_oldestReadback=0;
+}
+
+int GLKSnapshotWriter::GetWrittenNum()
+{
+	std::lock_guard<std::mutex> lock(m_jobMutex);
+	return m_writtenNum;
+}
+
+int GLKSnapshotWriter::GetFailedNum()
+{
+	std::lock_guard<std::mutex> lock(m_jobMutex);
+	return m_failedNum;
+}
+
+bool GLKSnapshotWriter::_retireOldest(bool bWait)
+{
+	Readback &readback=m_readbacks[m_oldestReadback];
+	if (readback.fence!=NULL) {
+		GLsync fence=(GLsync)readback.fence;
+		GLenum status=glClientWaitSync(fence,bWait?GL_SYNC_FLUSH_COMMANDS_BIT:0,bWait?1000000000ull:0);
+		if (!bWait && status==GL_TIMEOUT_EXPIRED) return false;
+		glDeleteSync(fence);	readback.fence=NULL;
+	}
+
+	EncodeJob *job=new EncodeJob;
+	job->width=readback.width;	job->height=readback.height;	job->filename=readback.filename;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,readback.pbo);
+	const unsigned char *pixels=(const unsigned char *)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+	if (pixels!=NULL) {
+		job->pixels.assign(pixels,pixels+readback.size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	readback.bBusy=false;
+	m_oldestReadback=(m_oldestReadback+1)%SNAPSHOT_PBO_NUM;		m_busyNum--;
+
+	if (job->pixels.empty()) {
+		printf("The pixels of %s could not be read back!\n",job->filename.c_str());
+		delete job;
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		m_failedNum++;
+		return true;
+	}
+	_queueJob(job);
+	return true;
+}
+
+void GLKSnapshotWriter::_queueJob(EncodeJob *job)
+{
+	{
+		//	Frames drawn faster than they are encoded wait here rather than pile up in memory
+		std::unique_lock<std::mutex> lock(m_jobMutex);
+		while(m_jobs.size()>=m_encoders.size()*2) m_jobDone.wait(lock);
+		m_jobs.push_back(job);
+	}
+	m_jobReady.notify_one();
+}
+
+void GLKSnapshotWriter::_encoderLoop()
+{
+	std::unique_lock<std::mutex> lock(m_jobMutex);
+	while(true) {
+		while(m_jobs.empty() && !m_bStop) m_jobReady.wait(lock);
+		if (m_jobs.empty()) return;
+		EncodeJob *job=m_jobs.front();	m_jobs.pop_front();
+		m_runningJobNum++;
+
+		lock.unlock();
+		bool bWritten=cura::PngWriter::write(job->filename.c_str(),job->width,job->height,4,&(job->pixels[0]),true);
+		if (!bWritten) printf("%s could not be written!\n",job->filename.c_str());
+		delete job;
+		lock.lock();
+
+		m_runningJobNum--;
+		if (bWritten) m_writtenNum++; else m_failedNum++;
+		m_jobDone.notify_all();
+	}
+}
@@ -0,0 +1,73 @@
+// GLKSnapshotWriter.h: interface for the GLKSnapshotWriter class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _CW_GLKSNAPSHOTWRITER
+#define _CW_GLKSNAPSHOTWRITER
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SNAPSHOT_PBO_NUM		4	// the readbacks in flight at once
+
+//	Writes frames to PNG files without stalling the drawing: the pixels are
+//	read into pixel buffer objects, which are mapped a few frames later once
+//	the GPU has filled them, and the images are encoded and written by
+//	worker threads. The GL functions need the context of the frames to be
+//	current; the readback is synchronous where pixel buffer objects are
+//	not supported.
+class GLKSnapshotWriter
+{
+public:
+	//	encoderNum - the number of encoding threads, 0 for half of the cores
+	GLKSnapshotWriter(int encoderNum=0);
+	virtual ~GLKSnapshotWriter();
+
+	//	Start reading the width x height pixels at the origin of the current
+	//	read buffer, to be written to filename; waits for the oldest readback
+	//	if all buffers are in use
+	void Capture(int width, int height, const char *filename);
+	//	Pass the readbacks the GPU has finished to the encoders, without waiting
+	//	where sync objects are supported
+	void Poll();
+	//	Wait until every capture has been written
+	void Flush();
+	//	Flush, then delete the buffer objects (while the context is current)
+	void ClearAll();
+
+	int GetWrittenNum();
+	int GetFailedNum();
+
+private:
+	struct Readback {
+		unsigned int pbo;	int size;
+		void *fence;		// GLsync, NULL if sync objects are not supported
+		bool bBusy;
+		int width, height;	std::string filename;
+	};
+	Readback m_readbacks[SNAPSHOT_PBO_NUM];
+	int m_nextReadback, m_oldestReadback, m_busyNum;
+
+	struct EncodeJob {
+		std::vector<unsigned char> pixels;
+		int width, height;	std::string filename;
+	};
+	std::deque<EncodeJob*> m_jobs;
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobReady, m_jobDone;
+	std::vector<std::thread> m_encoders;
+	int m_runningJobNum, m_writtenNum, m_failedNum;
+	bool m_bStop;
+
+	//	Map the buffer of the oldest readback and queue its pixels; false if
+	//	the GPU has not finished it and bWait is false
+	bool _retireOldest(bool bWait);
+	void _queueJob(EncodeJob *job);
+	void _encoderLoop();
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "PntsCaptureDevice.h"
+
+PntsCaptureDevice::PntsCaptureDevice(int ringSize)
+{
+	m_context = NULL;	m_device = NULL;
+	m_ring.resize((ringSize < 1) ? 1 : ringSize);
+	m_newest = -1;		m_frameNum = 0;
+	m_bStreaming = m_bStop = false;
+}
+
+PntsCaptureDevice::~PntsCaptureDevice(void)
+{
+	Stop();
+	if (m_context) delete m_context;
+}
+
+bool PntsCaptureDevice::Start(int warmupFrameNum)
+{
+	if (IsStreaming()) return true;
+	Stop();
+
+	//	A new context, to find a device plugged in since the last start
+	if (m_context) {delete m_context;	m_context = NULL;}
+	m_device = NULL;
+
+	PntsDepthFrame frame;
+	try {
+		rs::log_to_console(rs::log_severity::warn);
+		m_context = new rs::context;
+		printf("There are %d connected RealSense devices.\n", m_context->get_device_count());
+		if (m_context->get_device_count() == 0) {printf("No RealSense device is connected!\n");	return false;}
+
+		m_device = m_context->get_device(0);
+		printf("\nUsing device 0, an %s\n", m_device->get_name());
+		printf("    Serial number: %s\n", m_device->get_serial());
+		printf("    Firmware version: %s\n", m_device->get_firmware_version());
+
+		//	Configure depth and color to run with the device's preferred settings
+		m_device->enable_stream(rs::stream::depth, rs::preset::best_quality);
+		m_device->enable_stream(rs::stream::color, rs::preset::best_quality);
+		m_device->start();
+
+		frame.intrinsics = m_device->get_stream_intrinsics(rs::stream::depth);
+		frame.depthScale = m_device->get_depth_scale();
+	}
+	catch (const rs::error &e) {
+		printf("The RealSense device could not be started: %s\n", e.what());
+		m_device = NULL;
+		return false;
+	}
+	frame.width = frame.intrinsics.width;	frame.height = frame.intrinsics.height;
+	frame.depth.resize((size_t)frame.width * frame.height);
+	frame.number = 0;	frame.timestamp = 0.0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ring.assign(m_ring.size(), frame);
+		m_newest = -1;		m_frameNum = 0;
+		m_bStreaming = true;	m_bStop = false;
+	}
+	m_thread = std::thread(&PntsCaptureDevice::_streamLoop, this, frame, warmupFrameNum);
+	return true;
+}
+
+void PntsCaptureDevice::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	if (m_thread.joinable()) m_thread.join();
+	if (m_device) {
+		try {
+			if (m_device->is_streaming()) m_device->stop();
+		}
+		catch (const rs::error &e) {
+			printf("The RealSense device could not be stopped: %s\n", e.what());
+		}
+	}
+}
+
+bool PntsCaptureDevice::IsStreaming()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bStreaming;
+}
+
+bool PntsCaptureDevice::GetNewestFrame(PntsDepthFrame &frame, unsigned long long afterNumber, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	bool bArrived = m_frameReady.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+		[this, afterNumber] {return (m_newest >= 0 && m_ring[m_newest].number > afterNumber) || !m_bStreaming;});
+	if (!bArrived || m_newest < 0 || m_ring[m_newest].number <= afterNumber) return false;
+	frame = m_ring[m_newest];
+	return true;
+}
+
+void PntsCaptureDevice::_streamLoop(PntsDepthFrame frame, int warmupFrameNum)
+{
+	int droppedNum = 0;
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_bStop) break;
+		}
+		try {
+			m_device->wait_for_frames();
+			//	Dropped while the auto-exposure settles
+			if (droppedNum < warmupFrameNum) {droppedNum++;	continue;}
+
+			const uint16_t *depthImage = (const uint16_t*)m_device->get_frame_data(rs::stream::depth);
+			memcpy(&frame.depth[0], depthImage, sizeof(uint16_t) * frame.depth.size());
+			frame.timestamp = m_device->get_frame_timestamp(rs::stream::depth);
+		}
+		catch (const rs::error &e) {
+			printf("The RealSense stream has stopped: %s\n", e.what());
+			break;
+		}
+
+		//	Swapped into the slot after the newest, so the buffer of the oldest frame is
+		//	reused for the next one and the lock is held for no copy
+		std::lock_guard<std::mutex> lock(m_mutex);
+		int slot = (m_newest + 1) % (int)m_ring.size();
+		frame.number = ++m_frameNum;
+		std::swap(m_ring[slot], frame);
+		m_newest = slot;
+		m_frameReady.notify_all();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bStreaming = false;
+	m_frameReady.notify_all();
+}
+
+void PntsCaptureDevice::Deproject(const PntsDepthFrame &frame, float scaling,
+	std::vector<rs::float3> &points, std::vector<int> &pixelToPoint)
+{
+	points.clear();
+	points.reserve((size_t)frame.width * frame.height);
+	pixelToPoint.assign((size_t)frame.width * frame.height, -1);
+
+	for (int dy = 0; dy < frame.height; dy++) {
+		for (int dx = 0; dx < frame.width; dx++) {
+			//	Skip over pixels with a depth value of zero, which is used to indicate no data
+			uint16_t depthValue = frame.depth[dy * frame.width + dx];
+			if (depthValue == 0) continue;
+
+			rs::float2 depthPixel = {(float)dx, (float)dy};
+			rs::float3 p = frame.intrinsics.deproject(depthPixel, depthValue * frame.depthScale);
+			pixelToPoint[dy * frame.width + dx] = (int)points.size();
+			points.push_back(rs::float3{p.x * scaling, p.y * scaling, p.z * scaling});
+		}
+	}
+}
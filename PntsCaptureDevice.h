@@ -0,0 +1,63 @@
+#ifndef	_CCL_PNTS_CAPTURE_DEVICE
+#define	_CCL_PNTS_CAPTURE_DEVICE
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <librealsense/rs.hpp>
+
+//	A depth image as streamed by the device
+struct PntsDepthFrame {
+	std::vector<uint16_t> depth;	// width x height values, row by row, 0 where there is no data
+	int width, height;
+	float depthScale;				// meters per depth unit
+	rs::intrinsics intrinsics;
+	unsigned long long number;		// counts the frames kept since the stream was started, from 1
+	double timestamp;				// of the device, in milliseconds
+};
+
+//	Keeps the first RealSense device open and streaming on a background thread, which stores
+//	the depth frames into a small ring buffer, so that a frame can be taken at any time without
+//	opening the device and waiting for its auto-exposure to settle. A missing device or a
+//	failing stream is reported by the functions returning false, with the reason printed.
+class PntsCaptureDevice
+{
+public:
+	PntsCaptureDevice(int ringSize = 4);
+	~PntsCaptureDevice(void);
+
+	//	Open the device and start streaming, unless it is streaming already; the first
+	//	warmupFrameNum frames are dropped while the auto-exposure settles. Returns at once,
+	//	without waiting for the frames.
+	bool Start(int warmupFrameNum = 30);
+	void Stop();
+	bool IsStreaming();
+
+	//	Copy the newest frame numbered after afterNumber into frame, waiting up to timeoutMs
+	//	for one to arrive; false if none did or the stream has stopped
+	bool GetNewestFrame(PntsDepthFrame &frame, unsigned long long afterNumber = 0, int timeoutMs = 5000);
+
+	//	The points of the pixels with depth, in meters times scaling; pixelToPoint is set to
+	//	the index into points of each pixel, and -1 for the pixels without depth
+	static void Deproject(const PntsDepthFrame &frame, float scaling,
+		std::vector<rs::float3> &points, std::vector<int> &pixelToPoint);
+
+private:
+	rs::context *m_context;		rs::device *m_device;
+	std::thread m_thread;
+
+	std::mutex m_mutex;
+	std::condition_variable m_frameReady;
+	std::vector<PntsDepthFrame> m_ring;
+	int m_newest;				// the index of the newest frame in the ring, -1 if none
+	unsigned long long m_frameNum;
+	bool m_bStreaming, m_bStop;
+
+	void _streamLoop(PntsDepthFrame frame, int warmupFrameNum);
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+
+#include <deque>
+#include <queue>
+#include <utility>
+
+#include "PntsLODOctree.h"
+
+#include "utils/ThreadPool.h"
+using namespace cura;
+
+#define LOD_MAX_DEPTH		16		// Morton codes of 16 bits per axis
+
+PntsLODOctree::PntsLODOctree(void)
+{
+}
+
+PntsLODOctree::~PntsLODOctree(void)
+{
+}
+
+void PntsLODOctree::ClearAll()
+{
+	m_nodes.clear();
+	m_order.clear();
+}
+
+//	Stable LSD radix sort of the points by their codes, 16 bits per pass
+static void _sortByCodes(std::vector<uint64_t> &codes, std::vector<int> &indices)
+{
+	const int digitBits = 16, bucketNum = 1 << digitBits;
+	size_t num = codes.size();
+	std::vector<uint64_t> codeBuffer(num);	std::vector<int> indexBuffer(num);
+	std::vector<size_t> bucketBegin(bucketNum);
+	for (int shift = 0; shift < LOD_MAX_DEPTH * 3; shift += digitBits) {
+		memset(&bucketBegin[0], 0, sizeof(size_t) * bucketNum);
+		for (size_t i = 0; i < num; i++) bucketBegin[(codes[i] >> shift) & (bucketNum - 1)]++;
+		size_t sum = 0;
+		for (int b = 0; b < bucketNum; b++) {size_t count = bucketBegin[b]; bucketBegin[b] = sum; sum += count;}
+		for (size_t i = 0; i < num; i++) {
+			size_t pos = bucketBegin[(codes[i] >> shift) & (bucketNum - 1)]++;
+			codeBuffer[pos] = codes[i];		indexBuffer[pos] = indices[i];
+		}
+		codes.swap(codeBuffer);		indices.swap(indexBuffer);
+	}
+}
+
+//	Reorder the points [begin,begin+num) of the layout, which follow the Morton order, by the
+//	bit-reversed rank along that order: every prefix then takes points evenly spaced along the
+//	curve, so drawing only the first points of a node still covers all of its cell
+static void _stratifyRange(std::vector<int> &order, int begin, int num, std::vector<int> &buffer)
+{
+	if (num < 3) return;
+	int bits = 0;
+	while ((1 << bits) < num) bits++;
+	buffer.resize(num);
+	int k = 0;
+	for (int i = 0; i < (1 << bits); i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+		if (r < num) buffer[k++] = order[begin + r];
+	}
+	memcpy(&order[begin], &buffer[0], sizeof(int) * num);
+}
+
+void PntsLODOctree::Build(const float *pntPosArray, int pntsNum, int nodeCapacity)
+{
+	ClearAll();
+	if (pntsNum == 0) return;
+	if (nodeCapacity < 1) nodeCapacity = 1;
+
+	//--------------------------------------------------------------------------------------
+	//	The bounding cube
+	float minPos[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, maxPos[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (int i = 0; i < pntsNum; i++) {
+		for (int j = 0; j < 3; j++) {
+			float v = pntPosArray[i * 3 + j];
+			if (v < minPos[j]) minPos[j] = v;
+			if (v > maxPos[j]) maxPos[j] = v;
+		}
+	}
+	Node root;
+	root.halfSize = 0.0f;
+	for (int j = 0; j < 3; j++) {
+		root.center[j] = (minPos[j] + maxPos[j]) * 0.5f;
+		if ((maxPos[j] - minPos[j]) * 0.5f > root.halfSize) root.halfSize = (maxPos[j] - minPos[j]) * 0.5f;
+	}
+	root.halfSize = root.halfSize * 1.0001f + 1.0e-6f;
+	root.depth = 0;
+
+	//--------------------------------------------------------------------------------------
+	//	Morton codes: the 3 bits of level d (from the top) give the child at depth d+1,
+	//	so the points of every octree cell are consecutive after sorting by the codes
+	std::vector<uint64_t> codes(pntsNum);	std::vector<int> indices(pntsNum);
+	float origin[3] = {root.center[0] - root.halfSize, root.center[1] - root.halfSize, root.center[2] - root.halfSize};
+	float cellScale = (float)(1 << LOD_MAX_DEPTH) / (root.halfSize * 2.0f);
+	parallelFor(pntsNum, [&](size_t i) {
+		unsigned int q[3];
+		for (int j = 0; j < 3; j++) {
+			int v = (int)((pntPosArray[i * 3 + j] - origin[j]) * cellScale);
+			q[j] = (unsigned int)((v < 0) ? 0 : ((v >= (1 << LOD_MAX_DEPTH)) ? (1 << LOD_MAX_DEPTH) - 1 : v));
+		}
+		uint64_t code = 0;
+		for (int bit = LOD_MAX_DEPTH - 1; bit >= 0; bit--)
+			code = (code << 3) | (((q[0] >> bit) & 1) << 2) | (((q[1] >> bit) & 1) << 1) | ((q[2] >> bit) & 1);
+		codes[i] = code;	indices[i] = (int)i;
+	});
+	_sortByCodes(codes, indices);
+
+	//--------------------------------------------------------------------------------------
+	//	Breadth-first construction, so the coarse nodes come first in the point order. The
+	//	samples of a node are taken evenly along the Morton order, which spreads them over the
+	//	cell, and the points left are compacted in place for the children. The points of each
+	//	node are then stratified, so that any prefix of a node is a uniform subsample of it.
+	m_order.reserve(pntsNum);
+	std::vector<int> stratifyBuffer;
+	m_nodes.push_back(root);
+	struct Task {int node, begin, end;};
+	std::deque<Task> tasks;
+	Task rootTask = {0, 0, pntsNum};	tasks.push_back(rootTask);
+	while (!tasks.empty()) {
+		Task task = tasks.front();	tasks.pop_front();
+		int count = task.end - task.begin, depth = m_nodes[task.node].depth;
+		for (int c = 0; c < 8; c++) m_nodes[task.node].child[c] = -1;
+		m_nodes[task.node].pntBegin = (int)m_order.size();
+
+		if (count <= nodeCapacity || depth == LOD_MAX_DEPTH) {
+			for (int i = task.begin; i < task.end; i++) m_order.push_back(indices[i]);
+			m_nodes[task.node].pntNum = count;
+			_stratifyRange(m_order, m_nodes[task.node].pntBegin, count, stratifyBuffer);
+			continue;
+		}
+
+		int remainEnd = task.begin, sampleNum = 0;
+		double sampleStep = (double)count / (double)nodeCapacity;
+		for (int i = task.begin; i < task.end; i++) {
+			if (sampleNum < nodeCapacity && i - task.begin == (int)((sampleNum + 0.5) * sampleStep)) {
+				m_order.push_back(indices[i]);		sampleNum++;
+			}
+			else {
+				codes[remainEnd] = codes[i];	indices[remainEnd] = indices[i];	remainEnd++;
+			}
+		}
+		m_nodes[task.node].pntNum = sampleNum;
+		_stratifyRange(m_order, m_nodes[task.node].pntBegin, sampleNum, stratifyBuffer);
+
+		int shift = 3 * (LOD_MAX_DEPTH - 1 - depth);
+		for (int i = task.begin; i < remainEnd; ) {
+			int c = (int)((codes[i] >> shift) & 7), j = i + 1;
+			while (j < remainEnd && (int)((codes[j] >> shift) & 7) == c) j++;
+
+			Node child;
+			const Node &parent = m_nodes[task.node];
+			child.halfSize = parent.halfSize * 0.5f;
+			child.center[0] = parent.center[0] + ((c & 4) ? child.halfSize : -child.halfSize);
+			child.center[1] = parent.center[1] + ((c & 2) ? child.halfSize : -child.halfSize);
+			child.center[2] = parent.center[2] + ((c & 1) ? child.halfSize : -child.halfSize);
+			child.depth = depth + 1;
+			m_nodes.push_back(child);
+			int childIndex = (int)m_nodes.size() - 1;
+			m_nodes[task.node].child[c] = childIndex;
+
+			Task childTask = {childIndex, i, j};	tasks.push_back(childTask);
+			i = j;
+		}
+	}
+}
+
+float PntsLODOctree::_projectedRadius(const Node &node, const double modelView[16], const double projection[16],
+	const int viewport[4])
+{
+	const double *m = modelView, *p = projection;
+	double x = node.center[0], y = node.center[1], z = node.center[2];
+	double ex = m[0] * x + m[4] * y + m[8] * z + m[12];
+	double ey = m[1] * x + m[5] * y + m[9] * z + m[13];
+	double ez = m[2] * x + m[6] * y + m[10] * z + m[14];
+	double w = p[3] * ex + p[7] * ey + p[11] * ez + p[15];
+
+	double radius = node.halfSize * 1.7320508 * sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	if (w <= radius * fabs(p[11])) return FLT_MAX;		// the camera is inside or close to the node
+	double pixelScale = fabs(p[0]) * viewport[2];
+	if (fabs(p[5]) * viewport[3] > pixelScale) pixelScale = fabs(p[5]) * viewport[3];
+	return (float)(radius * pixelScale * 0.5 / w);
+}
+
+void PntsLODOctree::_computeFrustumPlanes(const double modelView[16], const double projection[16], double planes[6][4])
+{
+	//	The planes are the sums and differences of the last row of projection*modelView with
+	//	the other rows, pointing inwards
+	double clip[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			clip[col * 4 + row] = 0.0;
+			for (int k = 0; k < 4; k++) clip[col * 4 + row] += projection[k * 4 + row] * modelView[col * 4 + k];
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		for (int col = 0; col < 4; col++) {
+			planes[i * 2][col] = clip[col * 4 + 3] + clip[col * 4 + i];
+			planes[i * 2 + 1][col] = clip[col * 4 + 3] - clip[col * 4 + i];
+		}
+	}
+}
+
+bool PntsLODOctree::_isOutsideFrustum(const Node &node, const double planes[6][4])
+{
+	for (int i = 0; i < 6; i++) {
+		const double *pl = planes[i];
+		double dist = pl[0] * node.center[0] + pl[1] * node.center[1] + pl[2] * node.center[2] + pl[3];
+		double extent = node.halfSize * (fabs(pl[0]) + fabs(pl[1]) + fabs(pl[2]));
+		if (dist + extent < 0.0) return true;
+	}
+	return false;
+}
+
+bool PntsLODOctree::SelectNodes(const double modelView[16], const double projection[16], const int viewport[4],
+	int pointBudget, float minPixelSize, std::vector<int> &selected, int &selectedPntsNum,
+	const unsigned char *occluded)
+{
+	selected.clear();	selectedPntsNum = 0;
+	if (m_nodes.empty()) return true;
+
+	double planes[6][4];
+	_computeFrustumPlanes(modelView, projection, planes);
+	if (_isOutsideFrustum(m_nodes[0], planes)) return true;
+
+	std::priority_queue< std::pair<float, int> > candidates;
+	candidates.push(std::make_pair(_projectedRadius(m_nodes[0], modelView, projection, viewport), 0));
+	while (!candidates.empty()) {
+		int nodeIndex = candidates.top().second;
+		const Node &node = m_nodes[nodeIndex];
+		if (occluded != NULL && occluded[nodeIndex]) {
+			selected.push_back(nodeIndex);	candidates.pop();
+			continue;
+		}
+		if (selectedPntsNum + node.pntNum > pointBudget) return false;
+		selected.push_back(nodeIndex);	selectedPntsNum += node.pntNum;
+		candidates.pop();
+
+		for (int c = 0; c < 8; c++) {
+			if (node.child[c] < 0) continue;
+			const Node &child = m_nodes[node.child[c]];
+			if (_isOutsideFrustum(child, planes)) continue;
+			float radius = _projectedRadius(child, modelView, projection, viewport);
+			if (radius * 2.0f < minPixelSize) continue;
+			candidates.push(std::make_pair(radius, node.child[c]));
+		}
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+#ifndef	_CCL_PNTS_LOD_OCTREE
+#define	_CCL_PNTS_LOD_OCTREE
+
+#include <stddef.h>
+#include <vector>
+
+//	A level-of-detail octree over a point set, in the layered form: every point belongs to
+//	exactly one node. An inner node keeps an evenly spread subsample of the points below it,
+//	its children keep subsamples of the rest, and the leaves keep what remains. Drawing a node
+//	and some of its descendants therefore shows the region at a detail between the sample of
+//	the node and the full set.
+//
+//	The points of every node are consecutive in the order given by GetPointOrder(), so once
+//	the points are uploaded in that order each node is one range of a vertex buffer. Within a
+//	node the points are stratified: every prefix of the range is spread evenly over the cell,
+//	so a node can be drawn at a lower density by drawing the start of its range only.
+class PntsLODOctree
+{
+public:
+	PntsLODOctree(void);
+	~PntsLODOctree(void);
+
+	struct Node {
+		float center[3], halfSize;
+		int child[8];			// -1 if absent
+		int pntBegin, pntNum;	// the points of the node, as a range of the point order
+		int depth;
+	};
+
+	//	nodeCapacity - the number of points kept by an inner node, and the most by a leaf
+	void Build(const float *pntPosArray, int pntsNum, int nodeCapacity = 8192);
+	void ClearAll();
+
+	int GetPntsNum() {return (int)m_order.size();};
+	//	order[i] - the index of the point at the i-th position of the layout
+	const int* GetPointOrder() {return m_order.empty() ? NULL : &m_order[0];};
+	int GetNodeNum() {return (int)m_nodes.size();};
+	const Node& GetNode(int index) {return m_nodes[index];};
+
+	//	Select the nodes to draw from the matrices and viewport of the current view: the nodes
+	//	are taken by decreasing projected size as long as their points fit into pointBudget, a
+	//	node being refined only if its children cover more than minPixelSize pixels. Nodes
+	//	outside the view frustum are skipped together with their subtrees.
+	//		occluded - if not NULL, the nodes flagged in it are selected (so that their
+	//				visibility can be tested again) without their points and children
+	//		selected - the indices of the selected nodes, in the order they were selected
+	//	Returns true if no more nodes would be selected under an unlimited budget.
+	bool SelectNodes(const double modelView[16], const double projection[16], const int viewport[4],
+		int pointBudget, float minPixelSize, std::vector<int> &selected, int &selectedPntsNum,
+		const unsigned char *occluded = NULL);
+
+private:
+	std::vector<Node> m_nodes;
+	std::vector<int> m_order;
+
+	float _projectedRadius(const Node &node, const double modelView[16], const double projection[16],
+		const int viewport[4]);
+	void _computeFrustumPlanes(const double modelView[16], const double projection[16], double planes[6][4]);
+	bool _isOutsideFrustum(const Node &node, const double planes[6][4]);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "PntsScanPipeline.h"
+#include "PntsSetBody.h"
+
+#include "utils/ThreadPool.h"
+using namespace cura;
+
+typedef std::chrono::steady_clock ScanClock;
+
+static double _milliseconds(ScanClock::time_point from, ScanClock::time_point to)
+{
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+PntsScanPipeline::PntsScanPipeline(PntsCaptureDevice *device, int queueSize)
+{
+	m_device = device;
+	m_maxDepthJump = 0.05f;		m_minNeighborNum = 4;
+	m_scaling = 10.0f;			m_normalWindowRadius = 3;
+	for (int i = 0; i < SCAN_STAGE_UPLOAD; i++)
+		m_queues.push_back(new SpscQueue<ScanFrame*>((queueSize < 1) ? 1 : queueSize));
+	m_bRunning = m_bStop = false;
+	memset(m_records, 0, sizeof(m_records));
+	m_uploadFrame = NULL;
+	m_stagePool = new ThreadPool(getThreadCount());
+}
+
+PntsScanPipeline::~PntsScanPipeline(void)
+{
+	Stop();
+	for (size_t i = 0; i < m_queues.size(); i++) delete m_queues[i];
+	delete m_stagePool;
+}
+
+bool PntsScanPipeline::Start()
+{
+	Stop();
+	if (!m_device->Start()) return false;
+
+	memset(m_records, 0, sizeof(m_records));
+	m_startTime = ScanClock::now();
+	m_bStop = false;	m_bRunning = true;
+	for (int stage = SCAN_STAGE_ACQUISITION; stage < SCAN_STAGE_UPLOAD; stage++)
+		m_threads.push_back(std::thread(&PntsScanPipeline::_stageLoop, this, stage));
+	return true;
+}
+
+void PntsScanPipeline::Stop()
+{
+	m_bStop = true;
+	for (size_t i = 0; i < m_threads.size(); i++) m_threads[i].join();
+	m_threads.clear();
+	m_bRunning = false;
+
+	//	The point sets still in the queues have not been uploaded, so they hold no GL objects
+	ScanFrame *frame;
+	for (size_t i = 0; i < m_queues.size(); i++)
+		while (m_queues[i]->pop(frame)) _deleteFrame(frame);
+	if (m_uploadFrame) {_deleteFrame(m_uploadFrame);	m_uploadFrame = NULL;}
+}
+
+PntsSetBody* PntsScanPipeline::BeginUpload()
+{
+	ScanFrame *frame = NULL, *newerFrame;
+	int droppedNum = 0;
+	while (m_queues[SCAN_STAGE_UPLOAD - 1]->pop(newerFrame)) {
+		if (frame) {_deleteFrame(frame);	droppedNum++;}
+		frame = newerFrame;
+	}
+	if (droppedNum > 0) _recordDropped(SCAN_STAGE_UPLOAD, droppedNum);
+	if (frame == NULL) return NULL;
+
+	if (m_uploadFrame) _deleteFrame(m_uploadFrame);	// EndUpload was not called
+	m_uploadFrame = frame;		m_uploadBeginTime = ScanClock::now();
+	PntsSetBody *body = frame->body;
+	frame->body = NULL;
+	return body;
+}
+
+void PntsScanPipeline::EndUpload()
+{
+	if (m_uploadFrame == NULL) return;
+	_record(SCAN_STAGE_UPLOAD, m_uploadFrame->acquisitionTime, m_uploadBeginTime, ScanClock::now());
+	_deleteFrame(m_uploadFrame);	m_uploadFrame = NULL;
+}
+
+void PntsScanPipeline::GetStageStats(int stage, StageStats &stats)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	const StageRecord &record = m_records[stage];
+	double seconds = _milliseconds(m_startTime, ScanClock::now()) / 1000.0;
+	stats.frameNum = record.frameNum;		stats.droppedNum = record.droppedNum;
+	stats.busyTime = record.busyTime;
+	stats.latency = (record.frameNum > 0) ? record.latencySum / record.frameNum : 0.0;
+	stats.frameRate = (seconds > 0.0) ? record.frameNum / seconds : 0.0;
+}
+
+const char* PntsScanPipeline::GetStageName(int stage)
+{
+	static const char *names[SCAN_STAGE_NUM] = {"Acquisition", "Deprojection", "Filtering", "Normals", "Upload"};
+	return names[stage];
+}
+
+void PntsScanPipeline::PrintStats()
+{
+	printf("--------------------------------------------\n");
+	printf("%-14s %8s %8s %10s %12s %8s\n", "Stage", "Frames", "Dropped", "Busy (ms)", "Latency (ms)", "FPS");
+	for (int stage = 0; stage < SCAN_STAGE_NUM; stage++) {
+		StageStats stats;
+		GetStageStats(stage, stats);
+		printf("%-14s %8d %8d %10.2f %12.2f %8.2f\n", GetStageName(stage), stats.frameNum, stats.droppedNum,
+			(stats.frameNum > 0) ? stats.busyTime / stats.frameNum : 0.0, stats.latency, stats.frameRate);
+	}
+}
+
+void PntsScanPipeline::_stageLoop(int stage)
+{
+	ThreadPool::Use stagePool(*m_stagePool);
+	unsigned long long lastNumber = 0;
+	while (!m_bStop) {
+		ScanFrame *frame = NULL;
+		ScanClock::time_point beginTime;
+
+		if (stage == SCAN_STAGE_ACQUISITION) {
+			frame = new ScanFrame;		frame->body = NULL;
+			bool bArrived = m_device->GetNewestFrame(frame->depth, lastNumber, 100);
+			if (!bArrived) {
+				delete frame;
+				if (m_device->IsStreaming()) continue;
+				//	The stream has failed; the later stages stay idle until Stop
+				printf("The scanning has stopped with the device!\n");
+				m_bRunning = false;
+				return;
+			}
+			//	The frames the device streamed since the last one were never taken
+			if (lastNumber > 0 && frame->depth.number > lastNumber + 1)
+				_recordDropped(stage, (int)(frame->depth.number - lastNumber - 1));
+			lastNumber = frame->depth.number;
+			beginTime = frame->acquisitionTime = ScanClock::now();
+		}
+		else {
+			if (!m_queues[stage - 1]->pop(frame)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			beginTime = ScanClock::now();
+			switch (stage) {
+			case SCAN_STAGE_DEPROJECTION:	_deproject(frame);			break;
+			case SCAN_STAGE_FILTERING:		_filter(frame);				break;
+			case SCAN_STAGE_NORMALS:		_estimateNormals(frame);	break;
+			}
+		}
+		ScanClock::time_point endTime = ScanClock::now(), acquisitionTime = frame->acquisitionTime;
+
+		//	The acquisition drops the frame if the next stage is behind, to take a newer one
+		//	instead; the other stages wait for room, which holds back the stages before them
+		bool bPassed = m_queues[stage]->push(frame);
+		while (!bPassed && stage != SCAN_STAGE_ACQUISITION && !m_bStop) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			bPassed = m_queues[stage]->push(frame);
+		}
+		if (bPassed)
+			_record(stage, acquisitionTime, beginTime, endTime);
+		else {
+			if (!m_bStop) _recordDropped(stage, 1);
+			_deleteFrame(frame);
+		}
+	}
+}
+
+void PntsScanPipeline::_deproject(ScanFrame *frame)
+{
+	PntsCaptureDevice::Deproject(frame->depth, m_scaling, frame->points, frame->pixelToPoint);
+}
+
+void PntsScanPipeline::_filter(ScanFrame *frame)
+{
+	//	Flying pixels at the silhouettes lie between the foreground and the background, so
+	//	that few of their neighbors are at a similar depth
+	int width = frame->depth.width, height = frame->depth.height;
+	const std::vector<int> &pixelToPoint = frame->pixelToPoint;
+	const std::vector<rs::float3> &points = frame->points;
+	std::vector<unsigned char> bKeep(points.size(), 0);
+	//	A few rows at a time, as the rows are fewer than the default grain of parallelFor
+	ThreadPool::instance().parallelFor(height, 4, [&](size_t yBegin, size_t yEnd, unsigned int) {
+		for (int y = (int)yBegin; y < (int)yEnd; y++) {
+			for (int x = 0; x < width; x++) {
+				int index = pixelToPoint[y * width + x];
+				if (index < 0) continue;
+				float z = points[index].z, maxJump = m_maxDepthJump * fabs(z);
+				int neighborNum = 0;
+				for (int ny = y - 1; ny <= y + 1; ny++) {
+					if (ny < 0 || ny >= height) continue;
+					for (int nx = x - 1; nx <= x + 1; nx++) {
+						if (nx < 0 || nx >= width || (nx == x && ny == y)) continue;
+						int neighbor = pixelToPoint[ny * width + nx];
+						if (neighbor >= 0 && fabs(points[neighbor].z - z) <= maxJump) neighborNum++;
+					}
+				}
+				bKeep[index] = (neighborNum >= m_minNeighborNum);
+			}
+		}
+	});
+
+	std::vector<int> newIndex(points.size(), -1);
+	int keptNum = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		if (!bKeep[i]) continue;
+		newIndex[i] = keptNum;
+		frame->points[keptNum++] = points[i];
+	}
+	frame->points.resize(keptNum);
+	for (size_t i = 0; i < frame->pixelToPoint.size(); i++)
+		if (frame->pixelToPoint[i] >= 0) frame->pixelToPoint[i] = newIndex[frame->pixelToPoint[i]];
+}
+
+void PntsScanPipeline::_estimateNormals(ScanFrame *frame)
+{
+	PntsSetBody *body = new PntsSetBody;
+	body->setData(frame->points, frame->depth.width, frame->depth.height, frame->pixelToPoint);
+	body->calculateOrganizedNormals(m_normalWindowRadius);
+	body->CompRange();
+	frame->body = body;
+}
+
+void PntsScanPipeline::_record(int stage, std::chrono::steady_clock::time_point acquisitionTime,
+	std::chrono::steady_clock::time_point beginTime, std::chrono::steady_clock::time_point endTime)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	StageRecord &record = m_records[stage];
+	record.frameNum++;
+	record.busyTime += _milliseconds(beginTime, endTime);
+	record.latencySum += _milliseconds(acquisitionTime, endTime);
+}
+
+void PntsScanPipeline::_recordDropped(int stage, int num)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_records[stage].droppedNum += num;
+}
+
+void PntsScanPipeline::_deleteFrame(ScanFrame *frame)
+{
+	if (frame->body) delete frame->body;
+	delete frame;
+}
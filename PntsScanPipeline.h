@@ -0,0 +1,110 @@
+#ifndef	_CCL_PNTS_SCAN_PIPELINE
+#define	_CCL_PNTS_SCAN_PIPELINE
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PntsCaptureDevice.h"
+#include "utils/SpscQueue.h"
+
+class PntsSetBody;
+namespace cura {
+	class ThreadPool;
+}
+
+#define SCAN_STAGE_ACQUISITION		0
+#define SCAN_STAGE_DEPROJECTION		1
+#define SCAN_STAGE_FILTERING		2
+#define SCAN_STAGE_NORMALS			3
+#define SCAN_STAGE_UPLOAD			4
+#define SCAN_STAGE_NUM				5
+
+//	Continuous scanning: the frames of a capture device go through the stages of acquisition,
+//	deprojection, filtering of the flying pixels and normal estimation, each on a thread of its
+//	own, and the resulting point sets are uploaded to the GPU by the GL thread. The stages are
+//	connected by bounded lock-free queues; a stage waits while the next one is full, so a slow
+//	stage holds back the earlier ones until the acquisition drops frames, and the GL thread takes
+//	only the newest point set. Every stage keeps statistics of its latency and throughput.
+//	The filtering and the normal estimation split their rows over a ThreadPool of the pipeline,
+//	which runs a single parallel loop at a time: while one of the two stages is in a loop, the
+//	other waits for the pool, so they take turns at its threads rather than running side by
+//	side, and their busy times include that wait. The parallel loops of the GL thread (e.g. in
+//	the upload) run on the shared pool, so they never wait for a stage; the threads of the two
+//	pools compete for the cores only.
+class PntsScanPipeline
+{
+public:
+	//	queueSize - the frames held between two stages; each one adds up to the time of the
+	//	slowest stage to the latency once the pipeline is behind
+	PntsScanPipeline(PntsCaptureDevice *device, int queueSize = 1);
+	~PntsScanPipeline(void);
+
+	//	Start the device (unless it is streaming) and the stage threads; false if the device
+	//	could not be started
+	bool Start();
+	void Stop();
+	bool IsRunning() {return m_bRunning;};
+
+	//	The depth jump, relative to the depth, up to which a neighboring pixel counts as the same
+	//	surface, and the least number of such pixels among the 8 neighbors to keep a point
+	void SetFilter(float maxDepthJump, int minNeighborNum) {m_maxDepthJump = maxDepthJump; m_minNeighborNum = minNeighborNum;};
+	//	In meters times scaling, as PntsCaptureDevice::Deproject
+	void SetScaling(float scaling) {m_scaling = scaling;};
+	void SetNormalWindowRadius(int windowRadius) {m_normalWindowRadius = windowRadius;};
+
+	//	On the GL thread: the point set of the newest frame through the stages, with normals,
+	//	or NULL if none arrived since the last call (the older ones are dropped). The caller
+	//	takes it over and uploads it, then calls EndUpload for the statistics.
+	PntsSetBody* BeginUpload();
+	void EndUpload();
+
+	struct StageStats {
+		int frameNum;			// the frames passed on
+		int droppedNum;			// the frames dropped by the stage
+		double busyTime;		// in milliseconds, over all frames
+		double latency;			// the mean time in milliseconds from the acquisition to the end of the stage
+		double frameRate;		// the frames passed on per second since the start
+	};
+	void GetStageStats(int stage, StageStats &stats);
+	static const char* GetStageName(int stage);
+	void PrintStats();
+
+private:
+	struct ScanFrame {
+		PntsDepthFrame depth;
+		std::vector<rs::float3> points;
+		std::vector<int> pixelToPoint;
+		PntsSetBody *body;
+		std::chrono::steady_clock::time_point acquisitionTime;
+	};
+
+	PntsCaptureDevice *m_device;
+	float m_maxDepthJump;	int m_minNeighborNum;
+	float m_scaling;		int m_normalWindowRadius;
+
+	//	m_queues[i] - from the stage i to the stage i+1
+	std::vector<cura::SpscQueue<ScanFrame*>*> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<bool> m_bRunning, m_bStop;
+	cura::ThreadPool *m_stagePool;
+
+	std::mutex m_statsMutex;
+	struct StageRecord {int frameNum, droppedNum;	double busyTime, latencySum;};
+	StageRecord m_records[SCAN_STAGE_NUM];
+	std::chrono::steady_clock::time_point m_startTime, m_uploadBeginTime;
+	ScanFrame *m_uploadFrame;
+
+	void _stageLoop(int stage);
+	void _deproject(ScanFrame *frame);
+	void _filter(ScanFrame *frame);
+	void _estimateNormals(ScanFrame *frame);
+	void _record(int stage, std::chrono::steady_clock::time_point acquisitionTime,
+		std::chrono::steady_clock::time_point beginTime, std::chrono::steady_clock::time_point endTime);
+	void _recordDropped(int stage, int num);
+	void _deleteFrame(ScanFrame *frame);
+};
+
+#endif
@@ -15,35 +15,64 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <float.h>
+#include <algorithm>
 
 #include "PntsSetBody.h"
+#include "PntsLODOctree.h"
+#include "GLKLib/GLKShaderProgram.h"
 
-#include "utils/SparsePointGrid.h"
+#include "utils/IntegralCovarianceImage.h"
+#include "utils/NormalKernels.h"
+#include "utils/PointIndexGrid.h"
+#include "utils/ProgressReporter.h"
+#include "utils/ThreadPool.h"
 using namespace cura;
 
-#include <eigen3/Eigen/Core>
-#include <eigen3/Eigen/Eigenvalues>
-using namespace Eigen;
-
-
 #include <librealsense/rs.hpp>
 #include <librealsense/rs.h>
 
 extern GLK _pGLK;
 
+#define VBO_UPLOAD_CHUNK	(1 << 20)	// points per glBufferSubData
+#define VBO_DIRTY_BLOCK		4096		// points per block of the partial updates
+
 //----------------------------------------------------------------------------------------------------------------------
 PntsSetBody::PntsSetBody(void)
 {
 	m_range=1.0;		m_pntsNum=0;		
 	m_Lighting = false; 
 	m_withNormal = false;
-	m_drawListID_Points = m_drawListID_NormalArrow = -1;
+	m_vboPoints = 0;		m_vboPntsNum = 0;		m_vboPntsCapacity = 0;
+	m_normalArrowDisplay = false;	m_normalArrowLength = 1.0f;		m_normalArrowStride = 1;
+	m_arrowShader = NULL;	m_arrowShaderTried = false;
+	m_colorComponent = 0;	m_colorRange[0] = 0.0f;	m_colorRange[1] = 1.0f;
+	m_colormap = PNTS_COLORMAP_VIRIDIS;
+	m_colorShader = NULL;	m_colorShaderTried = false;
+	m_colormapTexture = 0;	m_colormapInTexture = -1;
+	m_attributeVersion = 0;
+	m_lodOctree = new PntsLODOctree();
+	m_lodPointBudget = 3000000;		m_lodFrameBudget = 0;
+	m_lodOcclusionCulling = false;
+	m_lodInteractiveFrameTime = 30.0f;
+	m_lodInteractivePntsNum = 1000000;	m_lodLastFrameInteractive = false;
+	m_renderOffset[0] = m_renderOffset[1] = m_renderOffset[2] = 0.0f;
+	m_renderDirtyChannels = 0;
+	memset(m_lodLastModelView, 0, sizeof(m_lodLastModelView));
+	memset(m_lodLastProjection, 0, sizeof(m_lodLastProjection));
+	m_pntsGrid = NULL;
+	m_imageWidth = m_imageHeight = 0;
+	m_normalSupportRadius = 0.0f;
+	m_normalNeighborNum = 20;
 }
 
 PntsSetBody::~PntsSetBody(void)
 {
 	ClearAll();
 	DeleteGLList();
+	delete m_lodOctree;
+	if (m_arrowShader != NULL) delete m_arrowShader;
+	if (m_colorShader != NULL) delete m_colorShader;
 }
 
 void PntsSetBody::ClearAll()
@@ -53,53 +82,181 @@ void PntsSetBody::ClearAll()
 		m_pntsNum=0;
 	}
 	m_range=1.0;
+	DeletePntsGrid();
+	m_indexFileName.clear();
+	m_imageWidth = m_imageHeight = 0;
+	m_pixelToPoint.clear();
+	m_dirtyPnts.clear();
+	m_normalSupportRadius = 0.0f;
+	m_attributes.clear();
+}
+
+void PntsSetBody::TakePoints(PntsSetBody *body)
+{
+	ClearAll();
+	m_pntsNum = body->m_pntsNum;	m_pntPosArray = body->m_pntPosArray;	m_normalArray = body->m_normalArray;
+	m_range = body->m_range;		m_withNormal = body->m_withNormal;
+	m_imageWidth = body->m_imageWidth;	m_imageHeight = body->m_imageHeight;
+	m_pixelToPoint.swap(body->m_pixelToPoint);
+	m_normalSupportRadius = body->m_normalSupportRadius;
+	//	New versions, so that no channel is taken for one already uploaded
+	m_attributes.swap(body->m_attributes);
+	for (size_t i = 0; i < m_attributes.size(); i++) m_attributes[i].version = ++m_attributeVersion;
+	body->m_pntsNum = 0;	body->ClearAll();
+	MarkRenderDirty(PNTS_CHANNEL_POSITION | PNTS_CHANNEL_NORMAL);
 }
 	
 void PntsSetBody::BuildGLList(bool bWithArrow)
 {
+	//	The buffer of points is kept if it has room for the points, so that replacing all of
+	//	them refills it rather than allocating another one
+	unsigned int vboPoints = m_vboPoints;	int vboCapacity = m_vboPntsCapacity;
+	m_vboPoints = 0;
 	DeleteGLList();
-	m_drawListID_Points = glGenLists(1);
-	if (bWithArrow)	m_drawListID_NormalArrow = glGenLists(1);
+	if (vboPoints != 0 && vboCapacity < m_pntsNum) {
+		glDeleteBuffers(1, &vboPoints);		vboPoints = 0;
+		//	Grown: leave room for the next few point sets, if they grow further
+		vboCapacity = m_pntsNum + m_pntsNum / 8;
+	}
+	else if (vboPoints == 0)
+		vboCapacity = m_pntsNum;
+	if (m_pntsNum == 0) {
+		if (vboPoints != 0) glDeleteBuffers(1, &vboPoints);
+		return;
+	}
+	m_vboPntsNum = m_pntsNum;
+	m_renderOffset[0] = m_renderOffset[1] = m_renderOffset[2] = 0.0f;
+	m_renderDirtyChannels = 0;	m_renderDirtyPnts.clear();
 
 	//--------------------------------------------------------------------------------------
-	//	Build the GL List for points
-	glNewList(m_drawListID_Points, GL_COMPILE);
-	glBegin(GL_POINTS);
-	for (int i = 0; i<m_pntsNum; i++) {
-		glNormal3f(m_normalArray[i * 3], m_normalArray[i * 3 + 1], m_normalArray[i * 3 + 2]);
-		glVertex3f(m_pntPosArray[i * 3], m_pntPosArray[i * 3 + 1], m_pntPosArray[i * 3 + 2]);
-	}
-	glEnd();
+	//	The buffer of points: all positions followed by all normals, in the order of the
+	//	octree nodes
+	m_lodOctree->Build(m_pntPosArray, m_pntsNum);
+	m_lodFrameBudget = 0;
+	m_vboPoints = vboPoints;	m_vboPntsCapacity = vboCapacity;
+	if (m_vboPoints == 0) {
+		glGenBuffers(1, &m_vboPoints);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)m_vboPntsCapacity * 3 * sizeof(float) * 2, NULL, GL_STATIC_DRAW);
+	}
+	else
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+	_uploadPoints(0, m_pntsNum, PNTS_CHANNEL_POSITION | PNTS_CHANNEL_NORMAL);
+
+	m_normalArrowDisplay = bWithArrow;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PntsSetBody::_uploadPoints(int slotBegin, int slotEnd, int channels)
+{
+	//	Gathered through the octree order chunk by chunk, so the driver does not have to
+	//	stage the whole cloud at once; the buffer must be bound
+	const int *order = m_lodOctree->GetPointOrder();
+	GLsizeiptr arraySize = (GLsizeiptr)m_vboPntsCapacity * 3 * sizeof(float);
+	std::vector<float> posChunk((size_t)MIN(VBO_UPLOAD_CHUNK, slotEnd - slotBegin) * 3), normalChunk(posChunk.size());
+	for (int i = slotBegin; i < slotEnd; i += VBO_UPLOAD_CHUNK) {
+		int num = MIN(VBO_UPLOAD_CHUNK, slotEnd - i);
+		parallelFor(num, [&](size_t j) {
+			size_t index = (size_t)order[i + j] * 3;
+			for (int k = 0; k < 3; k++) {
+				posChunk[j * 3 + k] = m_pntPosArray[index + k] - m_renderOffset[k];
+				normalChunk[j * 3 + k] = m_normalArray[index + k];
+			}
+		});
+		GLintptr offset = (GLintptr)i * 3 * sizeof(float);
+		GLsizeiptr size = (GLsizeiptr)num * 3 * sizeof(float);
+		if (channels & PNTS_CHANNEL_POSITION) glBufferSubData(GL_ARRAY_BUFFER, offset, size, &posChunk[0]);
+		if (channels & PNTS_CHANNEL_NORMAL) glBufferSubData(GL_ARRAY_BUFFER, arraySize + offset, size, &normalChunk[0]);
+	}
+}
+
+void PntsSetBody::MarkRenderDirty(int channels, const int *pntIndices, int num)
+{
+	if (pntIndices == NULL) {
+		m_renderDirtyChannels |= channels | PNTS_CHANNEL_ALLPNTS;
+		m_renderDirtyPnts.clear();
+		return;
+	}
+	m_renderDirtyChannels |= channels;
+	if (m_renderDirtyChannels & PNTS_CHANNEL_ALLPNTS) return;
+	m_renderDirtyPnts.insert(m_renderDirtyPnts.end(), pntIndices, pntIndices + num);
+}
+
+void PntsSetBody::TranslateRenderData(float dx, float dy, float dz)
+{
+	m_renderOffset[0] += dx;	m_renderOffset[1] += dy;	m_renderOffset[2] += dz;
+}
+
+void PntsSetBody::_flushRenderUpdates()
+{
+	if (m_renderDirtyChannels == 0 || m_vboPoints == 0) return;
+	int channels = m_renderDirtyChannels & (PNTS_CHANNEL_POSITION | PNTS_CHANNEL_NORMAL);
+	bool bAllPnts = (m_renderDirtyChannels & PNTS_CHANNEL_ALLPNTS) != 0;
+	m_renderDirtyChannels = 0;
+
 	//--------------------------------------------------------------------------------------
-	glEndList();
+	//	Points added, or moved out of the octree cells they were sorted into: the layout
+	//	itself is out of date and everything is built again
+	std::vector<int> dirtyPnts;		dirtyPnts.swap(m_renderDirtyPnts);
+	bool bRebuild = (m_pntsNum != m_vboPntsNum) || (bAllPnts && (channels & PNTS_CHANNEL_POSITION));
+	std::vector<int> slotOfPnt;
+	if (!bRebuild && !bAllPnts) {
+		const int *order = m_lodOctree->GetPointOrder();
+		slotOfPnt.resize(m_vboPntsNum);
+		for (int i = 0; i < m_vboPntsNum; i++) slotOfPnt[order[i]] = i;
+		if (channels & PNTS_CHANNEL_POSITION) {
+			std::vector<int> nodeBegin(m_lodOctree->GetNodeNum());
+			for (int i = 0; i < (int)nodeBegin.size(); i++) nodeBegin[i] = m_lodOctree->GetNode(i).pntBegin;
+			for (size_t i = 0; i < dirtyPnts.size() && !bRebuild; i++) {
+				if (dirtyPnts[i] < 0 || dirtyPnts[i] >= m_vboPntsNum) continue;
+				int slot = slotOfPnt[dirtyPnts[i]];
+				int nodeIndex = (int)(std::upper_bound(nodeBegin.begin(), nodeBegin.end(), slot) - nodeBegin.begin()) - 1;
+				const PntsLODOctree::Node &node = m_lodOctree->GetNode(nodeIndex);
+				for (int k = 0; k < 3; k++) {
+					float v = m_pntPosArray[(size_t)dirtyPnts[i] * 3 + k] - m_renderOffset[k];
+					if (fabs(v - node.center[k]) > node.halfSize) {bRebuild = true; break;}
+				}
+			}
+		}
+	}
+	if (bRebuild) {BuildGLList(m_normalArrowDisplay); return;}
 
 	//--------------------------------------------------------------------------------------
-	//	Build the GL List of drawProfile
-	if (bWithArrow) {
-		glNewList(m_drawListID_NormalArrow, GL_COMPILE);
-		float xx,yy,zz,arrowLength=1.0f;
-		glBegin(GL_LINES);
-		glColor3f(.5f,.5f,.5f);
-		//--------------------------------------------------------------------------------------
-		for(int i=0;i<m_pntsNum;i++) {
-			xx=m_pntPosArray[i*3];		yy=m_pntPosArray[i*3+1];	zz=m_pntPosArray[i*3+2];
-			glVertex3f(xx,yy,zz);
-			xx+=(m_normalArray[i*3]*arrowLength);
-			yy+=(m_normalArray[i*3+1]*arrowLength);
-			zz+=(m_normalArray[i*3+2]*arrowLength);
-			glVertex3f(xx,yy,zz);
+	//	Only the blocks holding changed points are uploaded
+	if (bAllPnts) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+		_uploadPoints(0, m_vboPntsNum, channels);
+	}
+	else {
+		int blockNum = (m_vboPntsNum + VBO_DIRTY_BLOCK - 1) / VBO_DIRTY_BLOCK;
+		std::vector<unsigned char> slotBlockDirty(blockNum, 0);
+		for (size_t i = 0; i < dirtyPnts.size(); i++) {
+			if (dirtyPnts[i] < 0 || dirtyPnts[i] >= m_vboPntsNum) continue;
+			slotBlockDirty[slotOfPnt[dirtyPnts[i]] / VBO_DIRTY_BLOCK] = 1;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+		for (int b = 0; b < blockNum; b++) {
+			if (!slotBlockDirty[b]) continue;
+			int e = b;	while (e + 1 < blockNum && slotBlockDirty[e + 1]) e++;
+			_uploadPoints(b * VBO_DIRTY_BLOCK, MIN((e + 1) * VBO_DIRTY_BLOCK, m_vboPntsNum), channels);
+			b = e;
 		}
-		//--------------------------------------------------------------------------------------
-		glEnd();
-		glEndList();
-		printf("CORRET: %d\n", m_drawListID_NormalArrow);
 	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void PntsSetBody::DeleteGLList()
 {
-	if (m_drawListID_Points != -1) { glDeleteLists(m_drawListID_Points, 1);	m_drawListID_Points = -1; }
-	if (m_drawListID_NormalArrow != -1) { glDeleteLists(m_drawListID_NormalArrow, 1);	m_drawListID_NormalArrow = -1; }
+	if (m_vboPoints != 0) { glDeleteBuffers(1, &m_vboPoints);	m_vboPoints = 0; }
+	m_vboPntsNum = 0;	m_vboPntsCapacity = 0;
+	m_lodOctree->ClearAll();
+	m_lodSelectedNodes.clear();
+	if (!m_lodQueries.empty()) glDeleteQueries((GLsizei)m_lodQueries.size(), &m_lodQueries[0]);
+	m_lodQueries.clear();	m_lodNodeOccluded.clear();	m_lodQueryPending.clear();
+	for (size_t i = 0; i < m_renderAttributes.size(); i++) glDeleteBuffers(1, &m_renderAttributes[i].vbo);
+	m_renderAttributes.clear();
+	if (m_colormapTexture != 0) { glDeleteTextures(1, &m_colormapTexture);	m_colormapTexture = 0; }
+	m_colormapInTexture = -1;
 }
 
 void PntsSetBody::CompRange()
@@ -138,15 +295,403 @@ void PntsSetBody::drawShade()
 	glLightModelf(GL_LIGHT_MODEL_TWO_SIDE, 1.0);
 	glColor3f(174.0f / 255.0f, 198.0f / 255.0f, 188.0f / 255.0f);
 	glEnable(GL_POINT_SMOOTH);	// without this, the rectangule will be displayed for point
-	glCallList(m_drawListID_Points);
+	_flushRenderUpdates();
+	if (m_vboPoints == 0) return;
+
+	glPushMatrix();
+	glTranslatef(m_renderOffset[0], m_renderOffset[1], m_renderOffset[2]);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*)0);
+	glNormalPointer(GL_FLOAT, 0, (const GLvoid*)((size_t)m_vboPntsCapacity * 3 * sizeof(float)));
+	bool bColored = _bindColorAttribute();
+	_drawLODNodes();
+	if (bColored) _unbindColorAttribute();
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glPopMatrix();
+}
+
+void PntsSetBody::_drawLODNodes()
+{
+	//--------------------------------------------------------------------------------------
+	//	While the view changes only the budget is drawn, once it stays the same the budget
+	//	grows frame by frame until the selection is complete
+	//	The buffers hold the points relative to the render offset
+	double modelView[16];	const double *projection = _pGLK.GetProjectionMatrix();
+	const GLint *viewport = _pGLK.GetViewport();
+	memcpy(modelView, _pGLK.GetModelViewMatrix(), sizeof(modelView));
+	for (int k = 0; k < 3; k++)
+		modelView[12 + k] += modelView[k] * m_renderOffset[0] + modelView[4 + k] * m_renderOffset[1] + modelView[8 + k] * m_renderOffset[2];
+	bool bViewChanged = memcmp(modelView, m_lodLastModelView, sizeof(m_lodLastModelView)) != 0
+		|| memcmp(projection, m_lodLastProjection, sizeof(m_lodLastProjection)) != 0;
+	if (bViewChanged || m_lodFrameBudget == 0) {
+		memcpy(m_lodLastModelView, modelView, sizeof(m_lodLastModelView));
+		memcpy(m_lodLastProjection, projection, sizeof(m_lodLastProjection));
+		m_lodFrameBudget = m_lodPointBudget;
+	}
+	else
+		m_lodFrameBudget = MIN(m_lodFrameBudget + m_lodPointBudget, m_vboPntsNum);
+
+	//	The parent already has about 1/8 of its samples, some 32 across, on each child, so
+	//	a child narrower than 32 pixels would add no visible detail. A cloud within the budget
+	//	is only culled, at full detail.
+	bool bFullDetail = (m_vboPntsNum <= m_lodPointBudget);
+	if (m_lodOcclusionCulling) _collectOcclusionResults();
+	int selectedPntsNum;
+	bool bComplete = m_lodOctree->SelectNodes(modelView, projection, viewport,
+		bFullDetail ? m_vboPntsNum : m_lodFrameBudget, bFullDetail ? 0.0f : 32.0f,
+		m_lodSelectedNodes, selectedPntsNum, m_lodOcclusionCulling ? &m_lodNodeOccluded[0] : NULL);
+
+	//--------------------------------------------------------------------------------------
+	//	While the view is dragged, the number of points drawn follows the frame time: it is
+	//	scaled by the ratio of the target to the time of the last such frame, by at most a
+	//	factor of two either way
+	float fraction = 1.0f;
+	bool bInteractive = _pGLK.IsInteracting();
+	if (bInteractive) {
+		if (m_lodLastFrameInteractive) {
+			int frameTime = _pGLK.GetLastFrameDuration();
+			float ratio = (frameTime > 0) ? m_lodInteractiveFrameTime / (float)frameTime : 2.0f;
+			ratio = MAX(0.5f, MIN(ratio, 2.0f));
+			if (ratio < 0.9f || ratio > 1.1f)
+				m_lodInteractivePntsNum = MAX(10000, MIN((int)(m_lodInteractivePntsNum * ratio), m_lodPointBudget));
+		}
+		if (selectedPntsNum > m_lodInteractivePntsNum) fraction = (float)m_lodInteractivePntsNum / (float)selectedPntsNum;
+	}
+	m_lodLastFrameInteractive = bInteractive;
+
+	if (m_lodOcclusionCulling)
+		_drawLODNodesWithQueries(modelView, fraction);
+	else if (fraction < 1.0f) {
+		//	The prefixes are not adjacent in the buffer, so they are drawn by one multi-draw
+		m_lodDrawFirsts.resize(m_lodSelectedNodes.size());	m_lodDrawCounts.resize(m_lodSelectedNodes.size());
+		int drawNum = 0;
+		for (size_t i = 0; i < m_lodSelectedNodes.size(); i++) {
+			const PntsLODOctree::Node &node = m_lodOctree->GetNode(m_lodSelectedNodes[i]);
+			int count = (int)ceil(node.pntNum * fraction);
+			if (count == 0) continue;
+			m_lodDrawFirsts[drawNum] = node.pntBegin;	m_lodDrawCounts[drawNum] = count;	drawNum++;
+		}
+		if (drawNum > 0) glMultiDrawArrays(GL_POINTS, (const GLint*)&m_lodDrawFirsts[0], (const GLsizei*)&m_lodDrawCounts[0], drawNum);
+	}
+	else {
+		//	Nodes adjacent in the buffer are drawn by one call
+		std::sort(m_lodSelectedNodes.begin(), m_lodSelectedNodes.end());
+		int rangeBegin = 0, rangeEnd = 0;
+		for (size_t i = 0; i < m_lodSelectedNodes.size(); i++) {
+			const PntsLODOctree::Node &node = m_lodOctree->GetNode(m_lodSelectedNodes[i]);
+			if (node.pntBegin != rangeEnd) {
+				if (rangeEnd > rangeBegin) glDrawArrays(GL_POINTS, rangeBegin, rangeEnd - rangeBegin);
+				rangeBegin = node.pntBegin;
+			}
+			rangeEnd = node.pntBegin + node.pntNum;
+		}
+		if (rangeEnd > rangeBegin) glDrawArrays(GL_POINTS, rangeBegin, rangeEnd - rangeBegin);
+	}
+
+	//	Refining a view being dragged is left until it settles
+	if (!bComplete && !bInteractive) _pGLK.Invalidate();
+}
+
+void PntsSetBody::_collectOcclusionResults()
+{
+	int nodeNum = m_lodOctree->GetNodeNum();
+	if ((int)m_lodQueries.size() != nodeNum) {
+		if (!m_lodQueries.empty()) glDeleteQueries((GLsizei)m_lodQueries.size(), &m_lodQueries[0]);
+		m_lodQueries.assign(nodeNum, 0);
+		if (nodeNum > 0) glGenQueries(nodeNum, &m_lodQueries[0]);
+		m_lodNodeOccluded.assign(nodeNum, 0);
+		m_lodQueryPending.assign(nodeNum, 0);
+		return;
+	}
+
+	//	Only the results which are ready are taken, the others are left for a later frame
+	//	rather than stalling on the GPU
+	bool bChanged = false;
+	for (int i = 0; i < nodeNum; i++) {
+		if (!m_lodQueryPending[i]) continue;
+		GLuint available = 0, samples = 0;
+		glGetQueryObjectuiv(m_lodQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+		glGetQueryObjectuiv(m_lodQueries[i], GL_QUERY_RESULT, &samples);
+		m_lodQueryPending[i] = 0;
+		unsigned char occluded = (samples == 0) ? 1 : 0;
+		if (occluded != m_lodNodeOccluded[i]) {m_lodNodeOccluded[i] = occluded; bChanged = true;}
+	}
+	if (bChanged) _pGLK.Invalidate();
+}
+
+void PntsSetBody::_drawLODNodesWithQueries(const double *modelView, float fraction)
+{
+	//--------------------------------------------------------------------------------------
+	//	Front to back, so that near points occlude the nodes behind them. A visible node is
+	//	drawn inside its query; an occluded one only has its box tested against the depth
+	//	buffer, without drawing anything.
+	const double *m = modelView;
+	std::vector< std::pair<double, int> > nodeOrder(m_lodSelectedNodes.size());
+	for (size_t i = 0; i < m_lodSelectedNodes.size(); i++) {
+		const PntsLODOctree::Node &node = m_lodOctree->GetNode(m_lodSelectedNodes[i]);
+		double ez = m[2] * node.center[0] + m[6] * node.center[1] + m[10] * node.center[2] + m[14];
+		nodeOrder[i] = std::make_pair(-ez, m_lodSelectedNodes[i]);
+	}
+	std::sort(nodeOrder.begin(), nodeOrder.end());
+
+	for (size_t i = 0; i < nodeOrder.size(); i++) {
+		int nodeIndex = nodeOrder[i].second;
+		const PntsLODOctree::Node &node = m_lodOctree->GetNode(nodeIndex);
+		bool bQuery = !m_lodQueryPending[nodeIndex];
+		if (bQuery) {glBeginQuery(GL_SAMPLES_PASSED, m_lodQueries[nodeIndex]); m_lodQueryPending[nodeIndex] = 1;}
+		int count = (fraction < 1.0f) ? (int)ceil(node.pntNum * fraction) : node.pntNum;
+		if (!m_lodNodeOccluded[nodeIndex]) {
+			if (count > 0) glDrawArrays(GL_POINTS, node.pntBegin, count);
+		}
+		else if (bQuery) {
+			float lo[3], hi[3];
+			for (int j = 0; j < 3; j++) {lo[j] = node.center[j] - node.halfSize; hi[j] = node.center[j] + node.halfSize;}
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);	glDepthMask(GL_FALSE);
+			glBegin(GL_QUADS);
+			glVertex3f(lo[0],lo[1],lo[2]);	glVertex3f(lo[0],hi[1],lo[2]);	glVertex3f(hi[0],hi[1],lo[2]);	glVertex3f(hi[0],lo[1],lo[2]);
+			glVertex3f(lo[0],lo[1],hi[2]);	glVertex3f(hi[0],lo[1],hi[2]);	glVertex3f(hi[0],hi[1],hi[2]);	glVertex3f(lo[0],hi[1],hi[2]);
+			glVertex3f(lo[0],lo[1],lo[2]);	glVertex3f(hi[0],lo[1],lo[2]);	glVertex3f(hi[0],lo[1],hi[2]);	glVertex3f(lo[0],lo[1],hi[2]);
+			glVertex3f(lo[0],hi[1],lo[2]);	glVertex3f(lo[0],hi[1],hi[2]);	glVertex3f(hi[0],hi[1],hi[2]);	glVertex3f(hi[0],hi[1],lo[2]);
+			glVertex3f(lo[0],lo[1],lo[2]);	glVertex3f(lo[0],lo[1],hi[2]);	glVertex3f(lo[0],hi[1],hi[2]);	glVertex3f(lo[0],hi[1],lo[2]);
+			glVertex3f(hi[0],lo[1],lo[2]);	glVertex3f(hi[0],hi[1],lo[2]);	glVertex3f(hi[0],hi[1],hi[2]);	glVertex3f(hi[0],lo[1],hi[2]);
+			glEnd();
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);	glDepthMask(GL_TRUE);
+		}
+		if (bQuery) glEndQuery(GL_SAMPLES_PASSED);
+	}
+}
+
+//	Attribute colors: the value of a point is mapped into the colormap texture by the vertex
+//	shader, which also applies the diffuse term of the fixed-function light, two-sided
+static const char *_colorVertexShader =
+	"#version 120\n"
+	"attribute float value;\n"
+	"uniform float minValue, maxValue;\n"
+	"uniform bool lighting;\n"
+	"varying float t, shade;\n"
+	"void main() {\n"
+	"	gl_Position = ftransform();\n"
+	"	t = clamp((value - minValue) / max(maxValue - minValue, 1.0e-20), 0.0, 1.0);\n"
+	"	vec3 n = gl_NormalMatrix * gl_Normal;\n"
+	"	vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+	"	shade = (lighting && dot(n, n) > 0.0) ? 0.2 + 0.8 * abs(dot(normalize(n), l)) : 1.0;\n"
+	"}\n";
+static const char *_colorFragmentShader =
+	"#version 120\n"
+	"uniform sampler1D colormap;\n"
+	"varying float t, shade;\n"
+	"void main() {\n"
+	"	gl_FragColor = vec4(texture1D(colormap, t).rgb * shade, 1.0);\n"
+	"}\n";
+
+#define COLORMAP_SIZE	256
+
+//	The colors at evenly spaced values, linearly interpolated in between
+static void _colormapColor(int colormap, float t, unsigned char rgb[3])
+{
+	static const float viridis[9][3] = {{68,1,84}, {71,44,122}, {59,81,139}, {44,113,142}, {33,144,141},
+		{39,173,129}, {92,200,99}, {170,220,50}, {253,231,37}};
+	static const float jet[9][3] = {{0,0,128}, {0,0,255}, {0,128,255}, {0,255,255}, {128,255,128},
+		{255,255,0}, {255,128,0}, {255,0,0}, {128,0,0}};
+	const float (*table)[3] = (colormap == PNTS_COLORMAP_JET) ? jet : viridis;
+	float x = t * 8.0f;
+	int i = MIN((int)x, 7);		float w = x - (float)i;
+	for (int k = 0; k < 3; k++) rgb[k] = (unsigned char)(table[i][k] * (1.0f - w) + table[i + 1][k] * w + 0.5f);
+}
+
+void PntsSetBody::SetColorAttribute(const char *name, int component)
+{
+	int components = 0;
+	const float *data = (name != NULL) ? GetAttribute(name, &components) : NULL;
+	if (data == NULL || component < 0 || component >= components) {
+		m_colorAttribute.clear();	m_colorComponent = 0;
+		return;
+	}
+	m_colorAttribute = name;	m_colorComponent = component;
+
+	float minValue = FLT_MAX, maxValue = -FLT_MAX;
+	for (int i = 0; i < m_pntsNum; i++) {
+		float v = data[(size_t)i * components + component];
+		if (v < minValue) minValue = v;
+		if (v > maxValue) maxValue = v;
+	}
+	if (m_pntsNum == 0) minValue = maxValue = 0.0f;
+	SetColorRange(minValue, maxValue);
+}
+
+bool PntsSetBody::_bindColorAttribute()
+{
+	if (m_colorAttribute.empty()) return false;
+	int components = 0;
+	const float *data = GetAttribute(m_colorAttribute.c_str(), &components);
+	if (data == NULL || m_colorComponent >= components) return false;
+	unsigned int version = 0;
+	for (size_t i = 0; i < m_attributes.size(); i++)
+		if (m_attributes[i].name == m_colorAttribute) version = m_attributes[i].version;
+
+	if (!m_colorShaderTried) {
+		m_colorShaderTried = true;
+		if (GLEW_VERSION_2_0) {
+			m_colorShader = new GLKShaderProgram();
+			if (!m_colorShader->AddShader(GL_VERTEX_SHADER, _colorVertexShader)
+				|| !m_colorShader->AddShader(GL_FRAGMENT_SHADER, _colorFragmentShader)
+				|| !m_colorShader->Link()) {
+				delete m_colorShader;	m_colorShader = NULL;
+			}
+		}
+		if (m_colorShader == NULL) printf("Shaders are not available, the points are drawn without attribute colors\n");
+	}
+	if (m_colorShader == NULL) return false;
+	int location = m_colorShader->GetAttribLocation("value");
+	if (location < 0) return false;
+
+	//--------------------------------------------------------------------------------------
+	//	The whole channel is uploaded, in the octree order, so that another of its
+	//	components is only another offset into the same buffer
+	size_t index = 0;
+	while (index < m_renderAttributes.size() && m_renderAttributes[index].name != m_colorAttribute) index++;
+	if (index == m_renderAttributes.size()) {
+		RenderAttribute renderAttribute;
+		renderAttribute.name = m_colorAttribute;	renderAttribute.version = 0;
+		glGenBuffers(1, &renderAttribute.vbo);
+		m_renderAttributes.push_back(renderAttribute);
+	}
+	RenderAttribute &renderAttribute = m_renderAttributes[index];
+	glBindBuffer(GL_ARRAY_BUFFER, renderAttribute.vbo);
+	if (renderAttribute.version != version) {
+		const int *order = m_lodOctree->GetPointOrder();
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)m_vboPntsNum * components * sizeof(float), NULL, GL_STATIC_DRAW);
+		std::vector<float> chunk((size_t)MIN(VBO_UPLOAD_CHUNK, m_vboPntsNum) * components);
+		for (int i = 0; i < m_vboPntsNum; i += VBO_UPLOAD_CHUNK) {
+			int num = MIN(VBO_UPLOAD_CHUNK, m_vboPntsNum - i);
+			parallelFor(num, [&](size_t j) {
+				memcpy(&chunk[j * components], &data[(size_t)order[i + j] * components], sizeof(float) * components);
+			});
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)i * components * sizeof(float),
+				(GLsizeiptr)num * components * sizeof(float), &chunk[0]);
+		}
+		renderAttribute.version = version;
+	}
+	glVertexAttribPointer(location, 1, GL_FLOAT, GL_FALSE, components * sizeof(float),
+		(const GLvoid*)((size_t)m_colorComponent * sizeof(float)));
+	glEnableVertexAttribArray(location);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+
+	//--------------------------------------------------------------------------------------
+	//	The colormap texture
+	if (m_colormapTexture == 0) {
+		glGenTextures(1, &m_colormapTexture);
+		glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+	if (m_colormapInTexture != m_colormap) {
+		unsigned char texels[COLORMAP_SIZE * 3];
+		for (int i = 0; i < COLORMAP_SIZE; i++) _colormapColor(m_colormap, (float)i / (float)(COLORMAP_SIZE - 1), &texels[i * 3]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, COLORMAP_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, texels);
+		m_colormapInTexture = m_colormap;
+	}
+
+	m_colorShader->Use();
+	m_colorShader->SetUniform1f("minValue", m_colorRange[0]);
+	m_colorShader->SetUniform1f("maxValue", m_colorRange[1]);
+	m_colorShader->SetUniform1i("lighting", glIsEnabled(GL_LIGHTING) ? 1 : 0);
+	m_colorShader->SetUniform1i("colormap", 0);
+	return true;
+}
+
+void PntsSetBody::_unbindColorAttribute()
+{
+	glDisableVertexAttribArray(m_colorShader->GetAttribLocation("value"));
+	GLKShaderProgram::UseNone();
+	glBindTexture(GL_TEXTURE_1D, 0);
 }
 
+//	Normal arrows generated from the point buffer: the geometry shader turns every point into
+//	a line along its normal, so arrows take no memory of their own
+static const char *_arrowVertexShader =
+	"#version 150 compatibility\n"
+	"out vec3 vNormal;\n"
+	"void main() {\n"
+	"	gl_Position = gl_Vertex;\n"
+	"	vNormal = gl_Normal;\n"
+	"}\n";
+static const char *_arrowGeometryShader =
+	"#version 150 compatibility\n"
+	"layout(points) in;\n"
+	"layout(line_strip, max_vertices = 2) out;\n"
+	"in vec3 vNormal[];\n"
+	"uniform float arrowLength;\n"
+	"void main() {\n"
+	"	vec4 p = gl_in[0].gl_Position;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * p;	EmitVertex();\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * (p + vec4(vNormal[0] * arrowLength, 0.0));	EmitVertex();\n"
+	"	EndPrimitive();\n"
+	"}\n";
+static const char *_arrowFragmentShader =
+	"#version 150 compatibility\n"
+	"void main() {\n"
+	"	gl_FragColor = vec4(0.5, 0.5, 0.5, 1.0);\n"
+	"}\n";
+
 void PntsSetBody::drawProfile()
 {
-	if (m_drawListID_NormalArrow < 0) return;
+	if (!m_normalArrowDisplay || m_vboPoints == 0) return;
+
+	if (!m_arrowShaderTried) {
+		m_arrowShaderTried = true;
+		if (GLEW_VERSION_3_2) {
+			m_arrowShader = new GLKShaderProgram();
+			if (!m_arrowShader->AddShader(GL_VERTEX_SHADER, _arrowVertexShader)
+				|| !m_arrowShader->AddShader(GL_GEOMETRY_SHADER, _arrowGeometryShader)
+				|| !m_arrowShader->AddShader(GL_FRAGMENT_SHADER, _arrowFragmentShader)
+				|| !m_arrowShader->Link()) {
+				delete m_arrowShader;	m_arrowShader = NULL;
+			}
+		}
+		if (m_arrowShader == NULL) printf("Geometry shaders are not available, normal arrows are drawn by the CPU\n");
+	}
 
 	glDisable(GL_LIGHTING);
-	glCallList(m_drawListID_NormalArrow);
+	glColor3f(.5f,.5f,.5f);
+	if (m_arrowShader == NULL) {
+		glBegin(GL_LINES);
+		for (int i = 0; i < m_pntsNum; i += m_normalArrowStride) {
+			const float *pos = &m_pntPosArray[(size_t)i * 3], *nv = &m_normalArray[(size_t)i * 3];
+			glVertex3fv(pos);
+			glVertex3f(pos[0] + nv[0] * m_normalArrowLength, pos[1] + nv[1] * m_normalArrowLength, pos[2] + nv[2] * m_normalArrowLength);
+		}
+		glEnd();
+		return;
+	}
+
+	//	Every n-th point is taken by widening the stride of the arrays; the buffer is in octree
+	//	order, so the points taken are spread over the whole cloud
+	GLsizei stride = (GLsizei)(m_normalArrowStride * 3 * sizeof(float));
+	glPushMatrix();
+	glTranslatef(m_renderOffset[0], m_renderOffset[1], m_renderOffset[2]);
+	m_arrowShader->Use();
+	m_arrowShader->SetUniform1f("arrowLength", m_normalArrowLength);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vboPoints);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)0);
+	glNormalPointer(GL_FLOAT, stride, (const GLvoid*)((size_t)m_vboPntsCapacity * 3 * sizeof(float)));
+	glDrawArrays(GL_POINTS, 0, (m_vboPntsNum + m_normalArrowStride - 1) / m_normalArrowStride);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLKShaderProgram::UseNone();
+	glPopMatrix();
 }
 	
 bool PntsSetBody::ImportPWNFile(char *filename)
@@ -302,13 +847,24 @@ bool PntsSetBody::ExportOBJFile(char *filename)
 	return true;
 }
 
-void PntsSetBody::calculateNormals(bool show_progress)
+void PntsSetBody::SetIndexFileName(const char *filename)
 {
+	m_indexFileName = filename;
+}
+
+void PntsSetBody::DeletePntsGrid()
+{
+	if (m_pntsGrid) {delete m_pntsGrid;	m_pntsGrid = NULL;}
+	//	Otherwise the next index would overwrite the file with that of the moved points,
+	//	which is rejected and rebuilt again when the file is loaded next time
+	m_indexFileName.clear();
+}
+
+PointIndexGrid* PntsSetBody::GetPntsGrid()
+{
+    if (m_pntsGrid) return m_pntsGrid;
+
     int avg_cells_per_dimension = 1000;
-    int k = 20;
-    
-    if (show_progress) std::cerr << "Constructing tree...\n";
-    int progress_steps = 100;
     
     FPoint3 min = FPoint3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     FPoint3 max = FPoint3(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
@@ -329,72 +885,177 @@ void PntsSetBody::calculateNormals(bool show_progress)
     FPoint3 size = max - min;
     float avg_size = (size.x + size.y + size.z) / 3.0;
     float cell_size = avg_size / avg_cells_per_dimension;
+    if (!(cell_size > 0)) cell_size = 1.0f;
+    
+    m_pntsGrid = new PointIndexGrid(cell_size);
+    if (m_indexFileName.empty()) {
+        m_pntsGrid->build(m_pntPosArray, m_pntsNum);
+        return m_pntsGrid;
+    }
+
+    uint64_t content_hash = PointIndexGrid::hashPositions(m_pntPosArray, m_pntsNum);
+    if (m_pntsGrid->load(m_indexFileName.c_str(), content_hash)) {
+        printf("Spatial index mapped from: %s\n", m_indexFileName.c_str());
+        return m_pntsGrid;
+    }
+    m_pntsGrid->build(m_pntPosArray, m_pntsNum);
+    if (!m_pntsGrid->save(m_indexFileName.c_str(), content_hash))
+        printf("Warning: the spatial index cannot be saved to: %s\n", m_indexFileName.c_str());
+    return m_pntsGrid;
+}
+
+int PntsSetBody::PickPoint(const double origin[], const double dir[], float pickRadius)
+{
+	//	The index is not built here, as picking follows the mouse motion
+	if (m_pntsNum==0 || m_pntsGrid==NULL) return -1;
+
+	unsigned int index;	float t;
+	FPoint3 rayOrigin((float)origin[0], (float)origin[1], (float)origin[2]);
+	FPoint3 rayDir((float)dir[0], (float)dir[1], (float)dir[2]);
+	if (!m_pntsGrid->pickAlongRay(rayOrigin, rayDir, pickRadius, 0.0f, index, t)) return -1;
+	return (int)index;
+}
+
+void PntsSetBody::calculateNormals(bool show_progress)
+{
+    if (show_progress) std::cerr << "Constructing tree...\n";
+    GetPntsGrid();
+    m_normalSupportRadius = 0.0f;
+    computeNormalsOf(NULL, m_pntsNum, show_progress);
+    m_dirtyPnts.clear();
+}
+
+void PntsSetBody::computeNormalsOf(const int* pntIndices, int num, bool show_progress)
+{
+    int k = m_normalNeighborNum;
     
+    const PointIndexGrid& grid = *GetPntsGrid();
+    float cell_size = grid.getCellSize();
     
-    struct Locator
+    // Buffers reused by all points handled by one thread
+    struct NormalScratch
     {
-        FPoint3 operator()(const FPoint3& p) const
-        { 
-            return p;
-        }
+        std::vector<PointIndexGrid::Neighbor> knn;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets;
+        std::vector<NormalKernels::Covariance> covs;
+        std::vector<float> normals;
+        float max_dist2;
     };
-    SparsePointGrid<FPoint3, Locator> grid(cell_size);
+    ThreadPool& pool = ThreadPool::instance();
+    std::vector<NormalScratch> scratches(pool.getThreadCount());
+    for (NormalScratch& scratch : scratches) scratch.max_dist2 = 0.0f;
     
-    for (int i = 0; i < m_pntsNum; i++)
+    // Each point only reads the positions and writes its own normal, so the
+    // result does not depend on the thread count or the order of the points.
+    // The neighborhoods of a whole range are collected first so that their
+    // covariances and eigenvectors can be computed in batches.
+    ProgressReporter progress("Calculating normals", num, show_progress);
+    pool.parallelFor(num, 256,
+        [this, k, cell_size, pntIndices, &grid, &scratches, &progress](size_t begin, size_t end, unsigned int thread_idx)
+        {
+            NormalScratch& scratch = scratches[thread_idx];
+            scratch.indices.clear();
+            scratch.offsets.assign(1, 0);
+            for (size_t j = begin; j < end; j++)
+            {
+                size_t i = pntIndices ? pntIndices[j] : j;
+                FPoint3 p(m_pntPosArray[i * 3], m_pntPosArray[i * 3 + 1], m_pntPosArray[i * 3 + 2]);
+                grid.getKnn(p, k, cell_size, scratch.knn);
+                for (const PointIndexGrid::Neighbor& nn : scratch.knn)
+                {
+                    scratch.indices.push_back(nn.idx);
+                }
+                scratch.offsets.push_back(scratch.indices.size());
+                if (!scratch.knn.empty()) scratch.max_dist2 = std::max(scratch.max_dist2, scratch.knn.back().dist2);
+            }
+            scratch.covs.resize(end - begin);
+            NormalKernels::computeCovariances(m_pntPosArray, scratch.indices.data(), scratch.offsets.data(), end - begin, scratch.covs.data());
+            scratch.normals.resize((end - begin) * 3);
+            NormalKernels::solveEigens(scratch.covs.data(), end - begin, NULL, scratch.normals.data());
+            for (size_t j = begin; j < end; j++)
+            {
+                size_t i = pntIndices ? pntIndices[j] : j;
+                float* normal = &m_normalArray[i * 3];
+                std::copy(&scratch.normals[(j - begin) * 3], &scratch.normals[(j - begin) * 3] + 3, normal);
+                if (normal[1] < 0)
+                {
+                    normal[0] *= -1.0;
+                    normal[1] *= -1.0;
+                    normal[2] *= -1.0;
+                }
+            }
+            progress.add(end - begin);
+        });
+    progress.finish();
+    
+    for (const NormalScratch& scratch : scratches)
     {
-        if (show_progress && i % (m_pntsNum / progress_steps) == 0) std::cerr << ".";
-        float& x = m_pntPosArray[i * 3];
-        float& y = m_pntPosArray[i * 3 + 1];
-        float& z = m_pntPosArray[i * 3 + 2];
-        grid.insert(FPoint3(x, y, z));
+        m_normalSupportRadius = std::max(m_normalSupportRadius, std::sqrt(scratch.max_dist2));
+    }
+    MarkRenderDirty(PNTS_CHANNEL_NORMAL, pntIndices, num);
+}
+
+void PntsSetBody::MarkPointsDirty(const int* pntIndices, int num)
+{
+    m_dirtyPnts.insert(m_dirtyPnts.end(), pntIndices, pntIndices + num);
+    m_indexFileName.clear();    // as in DeletePntsGrid
+    MarkRenderDirty(PNTS_CHANNEL_POSITION, pntIndices, num);
+}
+
+void PntsSetBody::updateNormals(bool show_progress)
+{
+    if (m_dirtyPnts.empty()) return;
+    if (!m_pntsGrid || m_normalSupportRadius <= 0.0f)
+    {
+        calculateNormals(show_progress);
+        return;
     }
     
-    if (show_progress) std::cerr << "\n";
+    // Points marked before the point set shrank no longer exist
+    std::sort(m_dirtyPnts.begin(), m_dirtyPnts.end());
+    m_dirtyPnts.erase(std::unique(m_dirtyPnts.begin(), m_dirtyPnts.end()), m_dirtyPnts.end());
+    m_dirtyPnts.erase(std::lower_bound(m_dirtyPnts.begin(), m_dirtyPnts.end(), m_pntsNum), m_dirtyPnts.end());
+    m_dirtyPnts.erase(m_dirtyPnts.begin(), std::lower_bound(m_dirtyPnts.begin(), m_dirtyPnts.end(), 0));
+    if (m_dirtyPnts.empty()) return;
+    std::vector<uint32_t> dirty(m_dirtyPnts.begin(), m_dirtyPnts.end());
     
+    // Move the points in the index, rebuilding it only when too many have
+    // left their cells
+    std::vector<float> old_positions(dirty.size() * 3);
+    if (!m_pntsGrid->updatePoints(m_pntPosArray, dirty.data(), dirty.size(), old_positions.data()))
+    {
+        DeletePntsGrid();
+        GetPntsGrid();
+    }
     
-    if (show_progress) std::cerr << "Calculating normals...\n";
-    for (int i = 0; i < m_pntsNum; i++)
+    // A neighborhood changes only when a changed point enters or leaves it.
+    // All neighborhoods lie within the support radius of their point, so
+    // the affected points are those near the old or new position of a
+    // changed point.
+    const PointIndexGrid& grid = *GetPntsGrid();
+    std::vector<int> affected(m_dirtyPnts);
+    std::vector<PointIndexGrid::Neighbor> nearby;
+    for (size_t d = 0; d < dirty.size(); d++)
     {
-        if (show_progress && i % (m_pntsNum / progress_steps) == 0) std::cerr << ".";
-        FPoint3 p(m_pntPosArray[i * 3], m_pntPosArray[i * 3 + 1], m_pntPosArray[i * 3 + 2]);
-        std::vector<FPoint3> knn = grid.getKnn(p, k, cell_size);
-        Eigen::MatrixXf mat(knn.size(), 3);
-        for (int nn_idx = 0; nn_idx < knn.size(); nn_idx++)
-        {
-            const FPoint3& nn = knn[nn_idx];
-            mat(nn_idx, 0) = nn.x;
-            mat(nn_idx, 1) = nn.y;
-            mat(nn_idx, 2) = nn.z;
-        }
-        MatrixXf centered = mat.rowwise() - mat.colwise().mean();
-        MatrixXf cov = (centered.adjoint() * centered) / double(mat.rows() - 1);
-        SelfAdjointEigenSolver<MatrixXf> es;
-        es.compute(cov);
-        Vector3f eigenvalues = es.eigenvalues();
-        int lowest_eigenvalue_idx = 0;
-        float lowest_eigenvalue = eigenvalues[0];
-        for (int eigenvalue_idx = 1; eigenvalue_idx < 3; eigenvalue_idx++)
+        const float* positions[2] = { &old_positions[d * 3], &m_pntPosArray[dirty[d] * 3] };
+        for (int pos_idx = 0; pos_idx < 2; pos_idx++)
         {
-            if (eigenvalues[eigenvalue_idx] < lowest_eigenvalue)
+            const float* p = positions[pos_idx];
+            if (std::isnan(p[0])) continue; // an added point has no old position
+            grid.getRadiusNeighbors(FPoint3(p[0], p[1], p[2]), m_normalSupportRadius, nearby);
+            for (const PointIndexGrid::Neighbor& nn : nearby)
             {
-                lowest_eigenvalue = eigenvalues[eigenvalue_idx];
-                lowest_eigenvalue_idx = eigenvalue_idx;
+                affected.push_back(nn.idx);
             }
         }
-        Vector3f last_component = es.eigenvectors().col(lowest_eigenvalue_idx);
-        if (last_component[1] < 0)
-        {
-            last_component *= -1.0;
-        }
-        float& normal_x = m_normalArray[i * 3];
-        float& normal_y = m_normalArray[i * 3 + 1];
-        float& normal_z = m_normalArray[i * 3 + 2];
-        normal_x = last_component[0];
-        normal_y = last_component[1];
-        normal_z = last_component[2];
-        
     }
-    if (show_progress) std::cerr << "Done.";
+    std::sort(affected.begin(), affected.end());
+    affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+    
+    if (show_progress) std::cerr << affected.size() << " normals affected by " << dirty.size() << " changed points\n";
+    computeNormalsOf(affected.data(), affected.size(), show_progress);
+    m_dirtyPnts.clear();
 }
 
 void PntsSetBody::alignNormals(float camera_normal_x, float camera_normal_y, float camera_normal_z)
@@ -414,15 +1075,45 @@ void PntsSetBody::alignNormals(float camera_normal_x, float camera_normal_y, flo
     }
 }
 
+float* PntsSetBody::AddAttribute(const char* name, int components)
+{
+	RemoveAttribute(name);
+	PntsAttribute attribute;
+	attribute.name = name;
+	attribute.components = components;
+	attribute.version = ++m_attributeVersion;
+	m_attributes.push_back(attribute);
+	m_attributes.back().data.assign((size_t)m_pntsNum * components, 0.0f);
+	return m_attributes.back().data.data();
+}
+
+float* PntsSetBody::GetAttribute(const char* name, int* components)
+{
+	for (size_t i = 0; i < m_attributes.size(); i++) {
+		if (m_attributes[i].name != name) continue;
+		if (components) *components = m_attributes[i].components;
+		return m_attributes[i].data.data();
+	}
+	return NULL;
+}
+
+void PntsSetBody::RemoveAttribute(const char* name)
+{
+	for (size_t i = 0; i < m_attributes.size(); i++) {
+		if (m_attributes[i].name != name) continue;
+		m_attributes.erase(m_attributes.begin() + i);
+		return;
+	}
+}
+
 void PntsSetBody::setData(const std::vector<rs::float3>& points)
 {
     ClearAll();
     
     m_pntsNum = points.size();
-//     if (m_pntPosArray) delete m_pntPosArray; 
-    m_pntPosArray = new float[points.size() * 3];
-//     if (m_normalArray) delete m_normalArray;
-    m_normalArray = new float[points.size() * 3];
+    // Allocated as by the file readers, since ClearAll frees them
+    m_pntPosArray = (float*)malloc(sizeof(float) * points.size() * 3);
+    m_normalArray = (float*)malloc(sizeof(float) * points.size() * 3);
     for (unsigned int p_idx = 0; p_idx < points.size(); p_idx++)
     {
         const rs::float3& p = points[p_idx];
@@ -431,3 +1122,136 @@ void PntsSetBody::setData(const std::vector<rs::float3>& points)
         m_pntPosArray[p_idx*3+2] = p.z;
     }
 }
+
+void PntsSetBody::setData(const std::vector<rs::float3>& points, int width, int height, const std::vector<int>& pixelToPoint)
+{
+    setData(points);
+    m_imageWidth = width;
+    m_imageHeight = height;
+    m_pixelToPoint = pixelToPoint;
+}
+
+void PntsSetBody::calculateOrganizedNormals(int windowRadius, bool show_progress, float maxDepthJump)
+{
+    if (!IsOrganized())
+    {
+        calculateNormals(show_progress);
+        return;
+    }
+    const int width = m_imageWidth, height = m_imageHeight;
+    ThreadPool& pool = ThreadPool::instance();
+    
+    IntegralCovarianceImage integral_image;
+    integral_image.build(m_pntPosArray, m_pixelToPoint.data(), width, height);
+    
+    // A window which holds pixels on both sides of a depth discontinuity mixes the foreground
+    // with the background. The pixels next to a discontinuity are counted in a summed-area
+    // table, so such windows are found in constant time and only they are summed pixel by
+    // pixel, skipping the neighbors beyond the jump.
+    auto isDepthJump = [this, maxDepthJump](int point_idx, int neighbor_idx)
+    {
+        float z = m_pntPosArray[point_idx * 3 + 2];
+        return std::fabs(m_pntPosArray[neighbor_idx * 3 + 2] - z) > maxDepthJump * std::fabs(z);
+    };
+    const size_t stride = width + 1;
+    std::vector<int> edge_sums(stride * (height + 1), 0);
+    pool.parallelFor(height, 4,
+        [&](size_t y_begin, size_t y_end, unsigned int)
+        {
+            for (int y = int(y_begin); y < int(y_end); y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    int point_idx = m_pixelToPoint[y * width + x];
+                    if (point_idx < 0) continue;
+                    bool is_edge = false;
+                    for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1) && !is_edge; ny++)
+                    {
+                        for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); nx++)
+                        {
+                            int neighbor_idx = m_pixelToPoint[ny * width + nx];
+                            if (neighbor_idx >= 0 && isDepthJump(point_idx, neighbor_idx)) { is_edge = true; break; }
+                        }
+                    }
+                    edge_sums[(y + 1) * stride + x + 1] = is_edge ? 1 : 0;
+                }
+            }
+        });
+    for (int y = 1; y <= height; y++)
+    {
+        for (size_t x = 1; x <= size_t(width); x++)
+        {
+            edge_sums[y * stride + x] += edge_sums[(y - 1) * stride + x] + edge_sums[y * stride + x - 1] - edge_sums[(y - 1) * stride + x - 1];
+        }
+    }
+    
+    // Rows are few but expensive, so they are handed out one at a time; the default grain of
+    // parallelFor would run all rows of a depth image on one thread
+    ProgressReporter progress("Calculating normals", height, show_progress);
+    pool.parallelFor(height, 1,
+        [&](size_t y_begin, size_t y_end, unsigned int)
+        {
+            std::vector<uint32_t> window_points((2 * windowRadius + 1) * (2 * windowRadius + 1));
+            // The covariances of a row are collected first, so that the eigenvectors are
+            // computed in one batch
+            std::vector<NormalKernels::Covariance> row_covs(width);
+            std::vector<int> row_points(width);
+            std::vector<float> row_normals(size_t(width) * 3);
+            for (int y = int(y_begin); y < int(y_end); y++)
+            {
+                const int y0 = std::max(0, y - windowRadius), y1 = std::min(height, y + windowRadius + 1);
+                size_t row_num = 0;
+                for (int x = 0; x < width; x++)
+                {
+                    int point_idx = m_pixelToPoint[y * width + x];
+                    if (point_idx < 0) continue;
+                    const int x0 = std::max(0, x - windowRadius), x1 = std::min(width, x + windowRadius + 1);
+                    int edge_num = edge_sums[y1 * stride + x1] - edge_sums[y0 * stride + x1]
+                        - edge_sums[y1 * stride + x0] + edge_sums[y0 * stride + x0];
+                    
+                    NormalKernels::Covariance& cov = row_covs[row_num];
+                    if (edge_num > 0)
+                    {
+                        size_t window_num = 0;
+                        for (int wy = y0; wy < y1; wy++)
+                        {
+                            for (int wx = x0; wx < x1; wx++)
+                            {
+                                int neighbor_idx = m_pixelToPoint[wy * width + wx];
+                                if (neighbor_idx >= 0 && !isDepthJump(point_idx, neighbor_idx)) window_points[window_num++] = neighbor_idx;
+                            }
+                        }
+                        // Too few pixels on the surface of this one to fit a plane; the whole
+                        // window would mix in the other side of the jump
+                        if (window_num < 3)
+                        {
+                            float* normal = &m_normalArray[point_idx * 3];
+                            normal[0] = normal[1] = normal[2] = 0.0f;
+                            continue;
+                        }
+                        NormalKernels::computeCovariance(m_pntPosArray, window_points.data(), window_num, cov);
+                    }
+                    else
+                        integral_image.getCovariance(x0, y0, x1, y1, cov);
+                    row_points[row_num++] = point_idx;
+                }
+                
+                NormalKernels::solveEigens(row_covs.data(), row_num, NULL, row_normals.data());
+                for (size_t j = 0; j < row_num; j++)
+                {
+                    float* normal = &m_normalArray[row_points[j] * 3];
+                    std::copy(&row_normals[j * 3], &row_normals[j * 3] + 3, normal);
+                    const float* p = &m_pntPosArray[row_points[j] * 3];
+                    if (normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2] > 0)
+                    {
+                        normal[0] *= -1.0;
+                        normal[1] *= -1.0;
+                        normal[2] *= -1.0;
+                    }
+                }
+            }
+            progress.add(y_end - y_begin);
+        });
+    progress.finish();
+    MarkRenderDirty(PNTS_CHANNEL_NORMAL);
+}
@@ -3,6 +3,7 @@
 
 #include "GLKLib/GLK.h"
 
+#include <string>
 #include <vector>
 
 #define MAX(a,b)		(((a)>(b))?(a):(b))
@@ -12,16 +13,44 @@ namespace rs {
 class float3; // forward declaration from rs::point3
 }
 
+namespace cura {
+class PointIndexGrid;
+}
+
+class PntsLODOctree;
+class GLKShaderProgram;
+
+#define PNTS_CHANNEL_POSITION	1
+#define PNTS_CHANNEL_NORMAL		2
+#define PNTS_CHANNEL_ALLPNTS	4	// internal: the channels changed for all points
+
+#define PNTS_COLORMAP_VIRIDIS	0
+#define PNTS_COLORMAP_JET		1
+
 class PntsSetBody : public GLKEntity
 {
 public:
 	PntsSetBody(void);
 	virtual ~PntsSetBody(void);
 
+	//	Upload the points into vertex buffer objects, in the order of the level-of-detail
+	//	octree; bWithArrow sets the display of the normal arrows
 	void BuildGLList(bool bWithArrow);
 	void DeleteGLList();
+	//	Mark channels (PNTS_CHANNEL_*) of the points as changed, all points if pntIndices is
+	//	NULL; the next drawShade uploads the changed blocks of the vertex buffers only
+	void MarkRenderDirty(int channels, const int *pntIndices = NULL, int num = 0);
+	//	Upload the changes marked so far now instead of on the next drawShade
+	void UpdateGLList() {_flushRenderUpdates();};
+	//	Move the drawn points by (dx,dy,dz) without uploading them again, for operations
+	//	which translate the whole point set
+	void TranslateRenderData(float dx, float dy, float dz);
 
 	void ClearAll();
+	//	Take over the points, normals and attributes of body, which is left empty. The vertex
+	//	buffers are kept and refilled on the next drawShade (or UpdateGLList), so a point set
+	//	replaced every frame, as by live scanning, is not built anew each time.
+	void TakePoints(PntsSetBody *body);
 
 	void CompRange();
 
@@ -40,6 +69,43 @@ public:
 	void SetLighting(bool bLight) {m_Lighting=bLight;};
 	bool GetLighting() {return m_Lighting;};
 
+	//	The normal arrows of drawProfile are generated from the point buffer when drawn, so
+	//	these take effect on the next frame without any upload
+	void SetNormalArrowDisplay(bool bDisplay) {m_normalArrowDisplay=bDisplay;};
+	bool GetNormalArrowDisplay() {return m_normalArrowDisplay;};
+	void SetNormalArrowLength(float length) {m_normalArrowLength=length;};
+	float GetNormalArrowLength() {return m_normalArrowLength;};
+	//	An arrow for every stride-th point
+	void SetNormalArrowStride(int stride) {m_normalArrowStride=(stride<1)?1:stride;};
+	int GetNormalArrowStride() {return m_normalArrowStride;};
+
+	//	The most points drawn in a frame while the view changes; once it stays the same, the
+	//	budget grows by this number every frame until the cloud is drawn at full detail
+	void SetLODPointBudget(int budget) {m_lodPointBudget=budget;};
+	int GetLODPointBudget() {return m_lodPointBudget;};
+	//	Skip the octree nodes hidden behind nearer points, by occlusion queries whose results
+	//	are used a frame or more later
+	void SetOcclusionCulling(bool bCulling) {m_lodOcclusionCulling=bCulling;};
+	bool GetOcclusionCulling() {return m_lodOcclusionCulling;};
+	//	While the view is dragged only a prefix of every selected node is drawn, as many points
+	//	as fit into this frame time (in milliseconds) by the times of the previous such frames;
+	//	the nodes are stratified, so the prefixes are uniform subsamples
+	void SetInteractiveFrameTime(float ms) {m_lodInteractiveFrameTime=ms;};
+	float GetInteractiveFrameTime() {return m_lodInteractiveFrameTime;};
+
+	//	Color the points by a component of an attribute channel (NULL for the plain color),
+	//	through the colormap from the low to the high end of the color range, which
+	//	SetColorAttribute sets to the range of the values. A channel is uploaded into a vertex
+	//	buffer when first drawn (and again once AddAttribute replaces it), so switching the
+	//	channel, component, range or colormap takes no upload of the points.
+	void SetColorAttribute(const char *name, int component = 0);
+	const char* GetColorAttribute() {return m_colorAttribute.empty() ? NULL : m_colorAttribute.c_str();};
+	int GetColorAttributeComponent() {return m_colorComponent;};
+	void SetColorRange(float minValue, float maxValue) {m_colorRange[0]=minValue; m_colorRange[1]=maxValue;};
+	void GetColorRange(float &minValue, float &maxValue) {minValue=m_colorRange[0]; maxValue=m_colorRange[1];};
+	void SetColormap(int colormap) {m_colormap=colormap;};	// PNTS_COLORMAP_*
+	int GetColormap() {return m_colormap;};
+
 	int GetPntsNum() {return m_pntsNum;};
 	float* GetPntPosArrayPtr() {return m_pntPosArray;};
 	float* GetNormalArrayPtr() {return m_normalArray;};
@@ -47,21 +113,156 @@ public:
 	void SetPntPosArrayPtr(float *ptr) {m_pntPosArray=ptr;};
 	void SetNormalArrayPtr(float *ptr) {m_normalArray=ptr;};
 
+	/*!
+	 * Get the spatial index over the points, mapping it from the index file
+	 * or building it (and saving it to the index file) when needed
+	 */
+	cura::PointIndexGrid* GetPntsGrid();
+	/*!
+	 * Get the index of the first point along a ray, -1 if no point is within
+	 * pickRadius of the ray; also -1 while the spatial index has not been built
+	 * by GetPntsGrid, which is left to the caller
+	 */
+	int PickPoint(const double origin[], const double dir[], float pickRadius);
+	/*!
+	 * Delete the spatial index once the points have moved; the index file then
+	 * no longer matches the positions, so it is left alone by the index built next
+	 */
+	void DeletePntsGrid();
+	//	The index file caches the index of the points as read from the file
+	void SetIndexFileName(const char *filename);
+
     void calculateNormals(bool show_progress = false);
 
+    /*!
+     * Record that the positions of some points have been changed in place;
+     * updateNormals then recomputes only the normals affected by them
+     */
+    void MarkPointsDirty(const int* pntIndices, int num);
+    bool HasDirtyPoints() {return !m_dirtyPnts.empty();};
+    /*!
+     * Recompute the normals of the points whose neighborhoods may contain a
+     * point marked dirty, at its old or new position. The spatial index is
+     * updated in place where possible. Falls back to calculateNormals when
+     * no normals have been calculated yet. Marked indices outside the point
+     * set are ignored.
+     */
+    void updateNormals(bool show_progress = false);
+    void SetNormalNeighborNum(int k) {m_normalNeighborNum=k;};
+    int GetNormalNeighborNum() {return m_normalNeighborNum;};
+
+    /*!
+     * Per-point attribute channels, e.g. geometric features: a named array
+     * of components floats per point. AddAttribute replaces a channel of
+     * the same name and returns its (zeroed) data; GetAttribute returns NULL
+     * when there is no channel of that name.
+     */
+    float* AddAttribute(const char* name, int components);
+    float* GetAttribute(const char* name, int* components = NULL);
+    void RemoveAttribute(const char* name);
+    int GetAttributeNum() {return (int)m_attributes.size();};
+    const char* GetAttributeName(int index) {return m_attributes[index].name.c_str();};
+
     /*!
      * Flip normals to align them with a given point
      */
     void alignNormals(float camera_normal_x, float camera_normal_y, float camera_normal_z);
     
     void setData(const std::vector<rs::float3>& points);
+    /*!
+     * Set data captured as a depth image of width x height pixels;
+     * pixelToPoint holds the index into points of each pixel, row by row,
+     * and -1 for pixels without depth
+     */
+    void setData(const std::vector<rs::float3>& points, int width, int height, const std::vector<int>& pixelToPoint);
+    bool IsOrganized() {return !m_pixelToPoint.empty();};
+
+    /*!
+     * Estimate normals of an organized point set from the pixels within
+     * windowRadius of each pixel of the depth image, using integral images
+     * so the cost per point does not depend on the window size. Neighbors
+     * whose depth differs by more than maxDepthJump times the depth of the
+     * pixel are left out, so normals do not blur across silhouettes; a point
+     * with fewer than 3 pixels left gets a zero normal. The normals are
+     * oriented towards the sensor at the origin.
+     */
+    void calculateOrganizedNormals(int windowRadius = 3, bool show_progress = false, float maxDepthJump = 0.05f);
 private:
 	bool m_Lighting;	float m_range;
-	int m_drawListID_Points, m_drawListID_NormalArrow;
+	unsigned int m_vboPoints;		// 0 when not built
+	int m_vboPntsNum;		// the number of points in the buffers
+	int m_vboPntsCapacity;	// the points the buffer has room for; the normals follow all of them
+
+	PntsLODOctree* m_lodOctree;
+	int m_lodPointBudget, m_lodFrameBudget;
+	double m_lodLastModelView[16], m_lodLastProjection[16];
+	std::vector<int> m_lodSelectedNodes;
+	bool m_lodOcclusionCulling;
+	std::vector<unsigned int> m_lodQueries;		// one occlusion query per octree node
+	std::vector<unsigned char> m_lodNodeOccluded, m_lodQueryPending;
+	float m_lodInteractiveFrameTime;
+	int m_lodInteractivePntsNum;	bool m_lodLastFrameInteractive;
+	std::vector<int> m_lodDrawFirsts, m_lodDrawCounts;
+
+	bool m_normalArrowDisplay;	float m_normalArrowLength;	int m_normalArrowStride;
+	GLKShaderProgram* m_arrowShader;	bool m_arrowShaderTried;
+
+	std::string m_colorAttribute;	int m_colorComponent;
+	float m_colorRange[2];	int m_colormap;
+	GLKShaderProgram* m_colorShader;	bool m_colorShaderTried;
+	unsigned int m_colormapTexture;	int m_colormapInTexture;	// -1 if none
+	struct RenderAttribute {
+		std::string name;
+		unsigned int vbo;
+		unsigned int version;	// of the channel uploaded
+	};
+	std::vector<RenderAttribute> m_renderAttributes;	// the channels in vertex buffers
+
+	float m_renderOffset[3];	// the buffers hold the positions minus this offset
+	int m_renderDirtyChannels;
+	std::vector<int> m_renderDirtyPnts;
 
 	bool m_withNormal;
 	int m_pntsNum;
 	float* m_pntPosArray;		float* m_normalArray;
+
+	int m_imageWidth, m_imageHeight;
+	std::vector<int> m_pixelToPoint;
+
+	cura::PointIndexGrid* m_pntsGrid;
+	std::string m_indexFileName;
+
+	struct PntsAttribute {
+		std::string name;
+		int components;
+		std::vector<float> data;
+		unsigned int version;	// a new one every time the channel is added
+	};
+	std::vector<PntsAttribute> m_attributes;
+	unsigned int m_attributeVersion;
+
+	int m_normalNeighborNum;
+	std::vector<int> m_dirtyPnts;
+	float m_normalSupportRadius;	// the largest distance to a neighbor used for a normal
+
+	/*!
+	 * Calculate the normals of the points pntIndices (of all points if NULL)
+	 */
+	void computeNormalsOf(const int* pntIndices, int num, bool show_progress);
+
+	//	Draw the octree nodes selected for the current view and point budget, culled against
+	//	the view frustum (and by occlusion queries if enabled)
+	void _drawLODNodes();
+	void _collectOcclusionResults();
+	//	fraction - of the points of every node to draw, from the start of its range
+	void _drawLODNodesWithQueries(const double *modelView, float fraction);
+	//	Upload the channels of the buffer positions [slotBegin,slotEnd) into the bound buffer
+	void _uploadPoints(int slotBegin, int slotEnd, int channels);
+	void _flushRenderUpdates();
+	//	Set up the drawing of the points colored by the selected attribute; false if there
+	//	is none or it cannot be drawn, leaving the plain color
+	bool _bindColorAttribute();
+	void _unbindColorAttribute();
 };
 
 #endif
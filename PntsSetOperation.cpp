@@ -5,6 +5,10 @@
 #include <math.h>
 #include <time.h>
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
 #if defined (__linux__)
 #include <sys/uio.h>
 #include <dirent.h>
@@ -15,6 +19,21 @@
 #include "PntsSetBody.h"
 #include "PntsSetOperation.h"
 
+#include "GLKLib/GLKIndexGraph.h"
+#include "utils/NormalKernels.h"
+#include "utils/PointIndexGrid.h"
+#include "utils/ThreadPool.h"
+using namespace cura;
+
+typedef std::chrono::steady_clock OperationClock;
+
+//	The wall-clock time since from, in milliseconds; clock() would count the CPU time of
+//	all threads of the parallel loops, in its own units
+static double _millisecondsSince(OperationClock::time_point from)
+{
+	return std::chrono::duration<double, std::milli>(OperationClock::now() - from).count();
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 PntsSetOperation::PntsSetOperation(void)
 {
@@ -49,4 +68,315 @@ void PntsSetOperation::MakeCenter(PntsSetBody *pntsBody)
 		pntsPosArrayPtr[i * 3 + 1] = pntsPosArrayPtr[i * 3 + 1] - cy;
 		pntsPosArrayPtr[i * 3 + 2] = pntsPosArrayPtr[i * 3 + 2] - cz;
 	}
+	pntsBody->DeletePntsGrid();
+	pntsBody->TranslateRenderData(-cx, -cy, -cz);
+}
+
+void PntsSetOperation::OrientNormalsByMST(PntsSetBody *pntsBody, int k)
+{
+	int pntsNum = pntsBody->GetPntsNum();
+	if (pntsNum == 0) return;
+	float *pntsPosArrayPtr = pntsBody->GetPntPosArrayPtr();
+	float *pntsNvArrayPtr = pntsBody->GetNormalArrayPtr();
+	OperationClock::time_point time = OperationClock::now();
+
+	//--------------------------------------------------------------------------------------
+	//	Riemannian graph: each point linked to its k nearest neighbors. The query asks for
+	//	k+1 points as it returns the point itself, which is left out; the slots of a point
+	//	with fewer neighbors are left as self-loops, which the MST skips.
+	const PointIndexGrid& grid = *(pntsBody->GetPntsGrid());
+	float cellSize = grid.getCellSize();
+	GLKIndexGraph graph(pntsNum);
+	graph.SetEdgeNum((size_t)pntsNum * k);
+	std::vector< std::vector<PointIndexGrid::Neighbor> > knnScratch(ThreadPool::instance().getThreadCount());
+	ThreadPool::instance().parallelFor(pntsNum, 256,
+		[&](size_t begin, size_t end, unsigned int threadIdx) {
+			std::vector<PointIndexGrid::Neighbor> &knn = knnScratch[threadIdx];
+			for (size_t i = begin; i < end; i++) {
+				FPoint3 p(pntsPosArrayPtr[i * 3], pntsPosArrayPtr[i * 3 + 1], pntsPosArrayPtr[i * 3 + 2]);
+				grid.getKnn(p, k + 1, cellSize, knn);
+				const float *ni = &pntsNvArrayPtr[i * 3];
+				size_t edgeIndex = i * k, edgeEnd = edgeIndex + k;
+				for (size_t slot = 0; slot < knn.size() && edgeIndex < edgeEnd; slot++) {
+					int j = knn[slot].idx;
+					if (j == (int)i) continue;
+					const float *nj = &pntsNvArrayPtr[j * 3];
+					float dot = ni[0] * nj[0] + ni[1] * nj[1] + ni[2] * nj[2];
+					graph.SetEdge(edgeIndex++, (int)i, j, 1.0f - fabs(dot));
+				}
+				for (; edgeIndex < edgeEnd; edgeIndex++) graph.SetEdge(edgeIndex, (int)i, (int)i, 1.0f);
+			}
+		});
+	printf("kNN graph with %zu edges built in %.1f ms\n", graph.GetEdgeNum(), _millisecondsSince(time)); time = OperationClock::now();
+
+	//--------------------------------------------------------------------------------------
+	//	Propagate the orientation from parents to children along the spanning forest
+	std::vector<int> parentNode(pntsNum), visitOrder(pntsNum);
+	graph.MinimumSpanningTree(-1, &parentNode[0], &visitOrder[0]);
+	for (int i = 0; i < pntsNum; i++) {
+		int node = visitOrder[i], parent = parentNode[node];
+		if (parent < 0) continue;
+		float *nc = &pntsNvArrayPtr[node * 3];
+		const float *np = &pntsNvArrayPtr[parent * 3];
+		if (nc[0] * np[0] + nc[1] * np[1] + nc[2] * np[2] < 0.0f) {
+			nc[0] = -nc[0];	nc[1] = -nc[1];	nc[2] = -nc[2];
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	//	The kNN graph falls apart into several trees where the cloud has separate parts. Each
+	//	tree is consistent in itself only, so each is flipped as a whole if needed to make the
+	//	normal of its highest point face upwards (+y), the rule by which the unoriented
+	//	normals are computed. The trees are contiguous in visitOrder, each from its root.
+	int treeBegin = 0;
+	while (treeBegin < pntsNum) {
+		int treeEnd = treeBegin + 1;
+		while (treeEnd < pntsNum && parentNode[visitOrder[treeEnd]] >= 0) treeEnd++;
+		int highest = visitOrder[treeBegin];
+		for (int i = treeBegin + 1; i < treeEnd; i++) {
+			if (pntsPosArrayPtr[visitOrder[i] * 3 + 1] > pntsPosArrayPtr[highest * 3 + 1]) highest = visitOrder[i];
+		}
+		if (pntsNvArrayPtr[highest * 3 + 1] < 0.0f) {
+			for (int i = treeBegin; i < treeEnd; i++) {
+				float *nc = &pntsNvArrayPtr[visitOrder[i] * 3];
+				nc[0] = -nc[0];	nc[1] = -nc[1];	nc[2] = -nc[2];
+			}
+		}
+		treeBegin = treeEnd;
+	}
+	pntsBody->MarkRenderDirty(PNTS_CHANNEL_NORMAL);
+	printf("Normals oriented along the MST in %.1f ms\n", _millisecondsSince(time));
+}
+
+void PntsSetOperation::ComputeMultiScaleFeatures(PntsSetBody *pntsBody, const int *scales, int scaleNum)
+{
+	int pntsNum = pntsBody->GetPntsNum();
+	if (pntsNum == 0 || scaleNum <= 0) return;
+	float *pntsPosArrayPtr = pntsBody->GetPntPosArrayPtr();
+	OperationClock::time_point time = OperationClock::now();
+
+	std::vector<int> sortedScales(scales, scales + scaleNum);
+	std::sort(sortedScales.begin(), sortedScales.end());
+	sortedScales.erase(std::unique(sortedScales.begin(), sortedScales.end()), sortedScales.end());
+	scaleNum = (int)sortedScales.size();
+	int kMax = sortedScales.back();
+
+	std::vector<float*> eigenChannels(scaleNum), featureChannels(scaleNum);
+	for (int s = 0; s < scaleNum; s++) {
+		char name[64];
+		sprintf(name, "eigenvalues_k%d", sortedScales[s]);	eigenChannels[s] = pntsBody->AddAttribute(name, 3);
+		sprintf(name, "features_k%d", sortedScales[s]);		featureChannels[s] = pntsBody->AddAttribute(name, 4);
+	}
+
+	//--------------------------------------------------------------------------------------
+	//	The neighbors come nearest first, so the sums over the first k of them give the
+	//	covariance of scale k. They are taken relative to the query point in double
+	//	precision, as the covariance is the difference of two large sums.
+	const PointIndexGrid& grid = *(pntsBody->GetPntsGrid());
+	float cellSize = grid.getCellSize();
+	std::vector< std::vector<PointIndexGrid::Neighbor> > knnScratch(ThreadPool::instance().getThreadCount());
+	ThreadPool::instance().parallelFor(pntsNum, 256,
+		[&](size_t begin, size_t end, unsigned int threadIdx) {
+			std::vector<PointIndexGrid::Neighbor> &knn = knnScratch[threadIdx];
+			for (size_t i = begin; i < end; i++) {
+				const float *p = &pntsPosArrayPtr[i * 3];
+				grid.getKnn(FPoint3(p[0], p[1], p[2]), kMax, cellSize, knn);
+				double sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+				int n = 0;
+				for (int s = 0; s < scaleNum; s++) {
+					int k = std::min(sortedScales[s], (int)knn.size());
+					for (; n < k; n++) {
+						const float *q = &pntsPosArrayPtr[knn[n].idx * 3];
+						double dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+						sx += dx;	sy += dy;	sz += dz;
+						sxx += dx * dx;	sxy += dx * dy;	sxz += dx * dz;
+						syy += dy * dy;	syz += dy * dz;	szz += dz * dz;
+					}
+					double count = std::max(n, 1), norm = std::max(n, 2) - 1;
+					NormalKernels::Covariance cov;
+					cov.mean[0] = (float)(p[0] + sx / count);	cov.mean[1] = (float)(p[1] + sy / count);	cov.mean[2] = (float)(p[2] + sz / count);
+					cov.xx = (float)((sxx - sx * sx / count) / norm);	cov.xy = (float)((sxy - sx * sy / count) / norm);
+					cov.xz = (float)((sxz - sx * sz / count) / norm);	cov.yy = (float)((syy - sy * sy / count) / norm);
+					cov.yz = (float)((syz - sy * sz / count) / norm);	cov.zz = (float)((szz - sz * sz / count) / norm);
+
+					float *ev = &eigenChannels[s][i * 3], normal[3];
+					NormalKernels::solveEigen(cov, ev, normal);
+					float *feature = &featureChannels[s][i * 4];
+					float sum = ev[0] + ev[1] + ev[2];
+					if (ev[2] > 0.0f) {
+						feature[0] = ev[0] / sum;
+						feature[1] = (ev[1] - ev[0]) / ev[2];
+						feature[2] = (ev[2] - ev[1]) / ev[2];
+						feature[3] = ev[0] / ev[2];
+					}
+					else
+						feature[0] = feature[1] = feature[2] = feature[3] = 0.0f;
+				}
+			}
+		});
+	printf("Features at %d scales (k up to %d) computed in %.1f ms\n", scaleNum, kMax, _millisecondsSince(time));
+}
+
+#define FPFH_BIN_NUM	11
+#define FPFH_DIM		(FPFH_BIN_NUM * 3)
+
+//	Adds the pair of points s and t to the simplified point feature histogram spfh,
+//	with the Darboux frame set up at the one whose normal is closer to the line
+static void _addPairToSPFH(const float *ps, const float *ns, const float *pt, const float *nt, float increment, float *spfh)
+{
+	float dp[3] = { pt[0] - ps[0], pt[1] - ps[1], pt[2] - ps[2] };
+	float dist = sqrt(dp[0] * dp[0] + dp[1] * dp[1] + dp[2] * dp[2]);
+	if (dist == 0.0f) return;
+	const float *n1 = ns, *n2 = nt;
+	float angle1 = (n1[0] * dp[0] + n1[1] * dp[1] + n1[2] * dp[2]) / dist;
+	float angle2 = (n2[0] * dp[0] + n2[1] * dp[1] + n2[2] * dp[2]) / dist;
+	float f3 = angle1;
+	if (fabs(angle1) < fabs(angle2)) {
+		n1 = nt;	n2 = ns;	f3 = -angle2;
+		dp[0] = -dp[0];	dp[1] = -dp[1];	dp[2] = -dp[2];
+	}
+	float v[3] = { dp[1] * n1[2] - dp[2] * n1[1], dp[2] * n1[0] - dp[0] * n1[2], dp[0] * n1[1] - dp[1] * n1[0] };
+	float vLength = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (vLength == 0.0f) return;
+	v[0] /= vLength;	v[1] /= vLength;	v[2] /= vLength;
+	float w[3] = { n1[1] * v[2] - n1[2] * v[1], n1[2] * v[0] - n1[0] * v[2], n1[0] * v[1] - n1[1] * v[0] };
+	float f2 = v[0] * n2[0] + v[1] * n2[1] + v[2] * n2[2];
+	float f1 = atan2(w[0] * n2[0] + w[1] * n2[1] + w[2] * n2[2], n1[0] * n2[0] + n1[1] * n2[1] + n1[2] * n2[2]);
+
+	int bin1 = (int)floor(FPFH_BIN_NUM * (f1 + (float)M_PI) / (float)(2.0 * M_PI));
+	int bin2 = (int)floor(FPFH_BIN_NUM * (f2 + 1.0f) * 0.5f);
+	int bin3 = (int)floor(FPFH_BIN_NUM * (f3 + 1.0f) * 0.5f);
+	spfh[std::min(std::max(bin1, 0), FPFH_BIN_NUM - 1)] += increment;
+	spfh[FPFH_BIN_NUM + std::min(std::max(bin2, 0), FPFH_BIN_NUM - 1)] += increment;
+	spfh[FPFH_BIN_NUM * 2 + std::min(std::max(bin3, 0), FPFH_BIN_NUM - 1)] += increment;
+}
+
+void PntsSetOperation::ComputeFPFH(PntsSetBody *pntsBody, int k, float radius)
+{
+	int pntsNum = pntsBody->GetPntsNum();
+	if (pntsNum == 0 || k <= 0) return;
+	float *pntsPosArrayPtr = pntsBody->GetPntPosArrayPtr();
+	float *pntsNvArrayPtr = pntsBody->GetNormalArrayPtr();
+	OperationClock::time_point time = OperationClock::now();
+
+	//--------------------------------------------------------------------------------------
+	//	Pass 1: the neighbors of every point, kept in fixed-size slots for the second pass,
+	//	and the SPFH of every point from its pairs with the neighbors. The query returns the
+	//	point itself as well, so k+1 slots are searched and the point is dropped.
+	const PointIndexGrid& grid = *(pntsBody->GetPntsGrid());
+	float cellSize = grid.getCellSize();
+	std::vector<int> neighborNum(pntsNum);
+	std::vector<unsigned int> neighborIndex((size_t)pntsNum * k);
+	std::vector<float> neighborDist((size_t)pntsNum * k);
+	std::vector<float> spfhArray((size_t)pntsNum * FPFH_DIM, 0.0f);
+	std::vector< std::vector<PointIndexGrid::Neighbor> > knnScratch(ThreadPool::instance().getThreadCount());
+	ThreadPool::instance().parallelFor(pntsNum, 256,
+		[&](size_t begin, size_t end, unsigned int threadIdx) {
+			std::vector<PointIndexGrid::Neighbor> &knn = knnScratch[threadIdx];
+			for (size_t i = begin; i < end; i++) {
+				const float *p = &pntsPosArrayPtr[i * 3];
+				if (radius > 0.0f)
+					grid.getRadiusNeighbors(FPoint3(p[0], p[1], p[2]), radius, knn, k + 1);
+				else
+					grid.getKnn(FPoint3(p[0], p[1], p[2]), k + 1, cellSize, knn);
+				unsigned int *indices = &neighborIndex[i * k];
+				float *dists = &neighborDist[i * k];
+				int num = 0;
+				for (size_t j = 0; j < knn.size() && num < k; j++) {
+					if (knn[j].idx == i) continue;
+					indices[num] = knn[j].idx;	dists[num] = sqrt(knn[j].dist2);	num++;
+				}
+				neighborNum[i] = num;
+				if (num == 0) continue;
+
+				float increment = 100.0f / (float)num, *spfh = &spfhArray[i * FPFH_DIM];
+				for (int j = 0; j < num; j++)
+					_addPairToSPFH(p, &pntsNvArrayPtr[i * 3], &pntsPosArrayPtr[indices[j] * 3], &pntsNvArrayPtr[indices[j] * 3], increment, spfh);
+			}
+		});
+
+	//--------------------------------------------------------------------------------------
+	//	Pass 2: FPFH = own SPFH + the SPFHs of the neighbors weighted by the inverse distance,
+	//	each of the three histograms of the weighted sum scaled to a total of 100
+	float *fpfhArray = pntsBody->AddAttribute("fpfh", FPFH_DIM);
+	ThreadPool::instance().parallelFor(pntsNum, 256,
+		[&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; i++) {
+				float weighted[FPFH_DIM] = { 0.0f }, *fpfh = &fpfhArray[i * FPFH_DIM];
+				const unsigned int *indices = &neighborIndex[i * k];
+				const float *dists = &neighborDist[i * k];
+				for (int j = 0; j < neighborNum[i]; j++) {
+					if (dists[j] == 0.0f) continue;
+					float weight = 1.0f / dists[j];
+					const float *spfh = &spfhArray[(size_t)indices[j] * FPFH_DIM];
+					for (int b = 0; b < FPFH_DIM; b++) weighted[b] += weight * spfh[b];
+				}
+				const float *spfh = &spfhArray[i * FPFH_DIM];
+				for (int h = 0; h < 3; h++) {
+					float sum = 0.0f;
+					for (int b = h * FPFH_BIN_NUM; b < (h + 1) * FPFH_BIN_NUM; b++) sum += weighted[b];
+					float scale = (sum > 0.0f) ? (100.0f / sum) : 0.0f;
+					for (int b = h * FPFH_BIN_NUM; b < (h + 1) * FPFH_BIN_NUM; b++) fpfh[b] = spfh[b] + scale * weighted[b];
+				}
+			}
+		});
+	printf("FPFH of %d points computed in %.1f ms\n", pntsNum, _millisecondsSince(time));
+}
+
+int PntsSetOperation::DetectISSKeypoints(PntsSetBody *pntsBody, std::vector<int> &keypoints, int k,
+	float nmsRadius, float gamma21, float gamma10)
+{
+	keypoints.clear();
+	int pntsNum = pntsBody->GetPntsNum();
+	if (pntsNum == 0 || k <= 0) return 0;
+	float *pntsPosArrayPtr = pntsBody->GetPntPosArrayPtr();
+
+	char name[64];	int components;
+	sprintf(name, "eigenvalues_k%d", k);
+	float *eigenvalues = pntsBody->GetAttribute(name, &components);
+	if (eigenvalues == NULL || components != 3) {
+		ComputeMultiScaleFeatures(pntsBody, &k, 1);
+		eigenvalues = pntsBody->GetAttribute(name);
+	}
+	OperationClock::time_point time = OperationClock::now();
+
+	//--------------------------------------------------------------------------------------
+	//	Saliency of the points with three well separated eigenvalues, -1 for the others
+	std::vector<float> saliency(pntsNum);
+	parallelFor(pntsNum, [&](size_t i) {
+		const float *ev = &eigenvalues[i * 3];
+		bool bDistinct = ev[2] > 0.0f && ev[1] > 0.0f && ev[1] < gamma21 * ev[2] && ev[0] < gamma10 * ev[1];
+		saliency[i] = bDistinct ? ev[0] : -1.0f;
+	});
+
+	//--------------------------------------------------------------------------------------
+	//	Non-maximum suppression, ties broken by the point index
+	const PointIndexGrid& grid = *(pntsBody->GetPntsGrid());
+	float cellSize = grid.getCellSize();
+	float *keypointChannel = pntsBody->AddAttribute("iss_keypoint", 1);
+	std::vector< std::vector<PointIndexGrid::Neighbor> > knnScratch(ThreadPool::instance().getThreadCount());
+	ThreadPool::instance().parallelFor(pntsNum, 256,
+		[&](size_t begin, size_t end, unsigned int threadIdx) {
+			std::vector<PointIndexGrid::Neighbor> &knn = knnScratch[threadIdx];
+			for (size_t i = begin; i < end; i++) {
+				if (saliency[i] < 0.0f) continue;
+				const float *p = &pntsPosArrayPtr[i * 3];
+				if (nmsRadius > 0.0f)
+					grid.getRadiusNeighbors(FPoint3(p[0], p[1], p[2]), nmsRadius, knn);
+				else
+					grid.getKnn(FPoint3(p[0], p[1], p[2]), k, cellSize, knn);
+				bool bMaximum = true;
+				for (size_t j = 0; j < knn.size() && bMaximum; j++) {
+					unsigned int idx = knn[j].idx;
+					if (saliency[idx] > saliency[i] || (saliency[idx] == saliency[i] && idx < i)) bMaximum = false;
+				}
+				if (bMaximum) keypointChannel[i] = 1.0f;
+			}
+		});
+
+	for (int i = 0; i < pntsNum; i++) {
+		if (keypointChannel[i] > 0.0f) keypoints.push_back(i);
+	}
+	printf("%d ISS keypoints detected in %.1f ms\n", (int)keypoints.size(), _millisecondsSince(time));
+	return (int)keypoints.size();
 }
@@ -1,6 +1,8 @@
 #ifndef _CCL_PNTCUDA_OPERATION
 #define _CCL_PNTCUDA_OPERATION
 
+#include <vector>
+
 class PntsSetBody;
 
 class PntsSetOperation
@@ -10,6 +12,29 @@ public:
 	~PntsSetOperation(void);
 
 	static void MakeCenter(PntsSetBody *pntsBody);
+	//	Orient the normals consistently by propagating the orientation along the minimum
+	//	spanning tree of the k-nearest-neighbor graph weighted by 1-|ni.nj| (Hoppe et al. 1992),
+	//	starting from the highest point whose normal is made to point upwards (+y); every
+	//	part of the cloud not linked to the others by the graph is oriented by its own highest point
+	static void OrientNormalsByMST(PntsSetBody *pntsBody, int k = 8);
+	//	Compute eigenvalue features of the k-nearest-neighborhoods for each k in scales, by one
+	//	neighbor query for the largest k of which the smaller scales use the nearest part. For
+	//	each scale k two attribute channels are added to the point set:
+	//		"eigenvalues_k<k>" - the covariance eigenvalues l0 <= l1 <= l2
+	//		"features_k<k>"    - surface variation l0/(l0+l1+l2), planarity (l1-l0)/l2,
+	//		                     linearity (l2-l1)/l2 and sphericity l0/l2
+	static void ComputeMultiScaleFeatures(PntsSetBody *pntsBody, const int *scales, int scaleNum);
+	//	Fast Point Feature Histograms from the normals of the point set, stored as the 33-float
+	//	attribute channel "fpfh" (11 bins for each of the three pair angles). The neighborhood is
+	//	the k nearest points, limited to those within radius if radius > 0.
+	static void ComputeFPFH(PntsSetBody *pntsBody, int k = 16, float radius = 0.0f);
+	//	Intrinsic Shape Signature keypoints: the points whose k-neighborhood has three distinct
+	//	eigenvalues (l1/l2 < gamma21 and l0/l1 < gamma10) and whose saliency l0 is the largest
+	//	among the neighbors within nmsRadius (the k nearest points if nmsRadius <= 0). The
+	//	eigenvalues are taken from the channel "eigenvalues_k<k>", computed first if missing.
+	//	The keypoints are marked with 1 in the channel "iss_keypoint". Returns their number.
+	static int DetectISSKeypoints(PntsSetBody *pntsBody, std::vector<int> &keypoints, int k = 20,
+		float nmsRadius = 0.0f, float gamma21 = 0.975f, float gamma10 = 0.975f);
 
 //	static void OrthogonalNormalOrientation(PntsSetBody *pntsBody, int voxRes, ortPnts_type type = pntsOrtFBLR);
 //	static void PCANormalEvaluation(PntsSetBody *pntsBody, int hashingRes, float supportSize);
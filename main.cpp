@@ -19,13 +19,20 @@
 #include <string.h>
 #include <time.h>
 
+#include <chrono>
+#include <thread>
+
 #include "GLKLib/GLK.h"
 #include "GLKLib/GLKCameraTool.h"
+#include "GLKLib/GLKOffscreenContext.h"
+#include "GLKLib/GLKSnapshotWriter.h"
 
 #include "PntsDataBoard.h"
 
 #include "PntsSetBody.h"
 #include "PntsSetOperation.h"
+#include "PntsCaptureDevice.h"
+#include "PntsScanPipeline.h"
 
 #include <librealsense/rs.hpp>
 #include <librealsense/rs.h>
@@ -59,16 +66,68 @@
 #define _MENU_VIEW_PNTNORMALVECDISP		10120
 #define _MENU_VIEW_SNAPSHOT				10121
 #define _MENU_CAPTURE_REALSENSE         10122
+#define _MENU_VIEW_OCCLUSIONCULLING		10123
+#define _MENU_VIEW_NORMALARROWLONGER	10124
+#define _MENU_VIEW_NORMALARROWSHORTER	10125
+#define _MENU_VIEW_NORMALARROWDENSER	10126
+#define _MENU_VIEW_NORMALARROWSPARSER	10127
+#define _MENU_VIEW_FRAMESTATS			10128
+#define _MENU_VIEW_COLORATTRIBUTE		10129
+#define _MENU_CAPTURE_LIVESCAN			10130
 
 #define _MENU_PNTS_PCANORMALEVA			10201
 #define _MENU_PNTS_VDFIELDCONSTRUCT		10202
 #define _MENU_PNTS_MEDIALAXISAPPROX		10203
 #define _MENU_PNTS_MAKECENTER			10204
+#define _MENU_PNTS_MSTNORMALORIENT		10205
+#define _MENU_PNTS_MULTISCALEFEATURE	10206
+#define _MENU_PNTS_FPFH					10207
+#define _MENU_PNTS_ISSKEYPOINT			10208
 #define _MENU_PNTS_CSRSHELLO			10299
 
+#define _PICK_TOLERANCE_PIXELS			4
+
 GLK _pGLK;
 PntsDataBoard _pDataBoard;
 int _pMainWnd;
+GLKSnapshotWriter *_pSnapshotWriter=NULL;
+PntsCaptureDevice *_pCaptureDevice=NULL;
+PntsScanPipeline *_pScanPipeline=NULL;
+
+void menuFuncPntsMSTNormalOrientation()
+{
+	if (!(_pDataBoard.m_pntsSetBody)) {
+		printf("None point-set is found!\n");	return;
+	}
+	PntsSetOperation::OrientNormalsByMST(_pDataBoard.m_pntsSetBody);
+	_pGLK.refresh();
+}
+
+void menuFuncPntsMultiScaleFeatures()
+{
+	if (!(_pDataBoard.m_pntsSetBody)) {
+		printf("None point-set is found!\n");	return;
+	}
+	int scales[] = { 10, 20, 40 };
+	PntsSetOperation::ComputeMultiScaleFeatures(_pDataBoard.m_pntsSetBody, scales, 3);
+}
+
+void menuFuncPntsFPFH()
+{
+	if (!(_pDataBoard.m_pntsSetBody)) {
+		printf("None point-set is found!\n");	return;
+	}
+	PntsSetOperation::ComputeFPFH(_pDataBoard.m_pntsSetBody);
+}
+
+void menuFuncPntsISSKeypoints()
+{
+	if (!(_pDataBoard.m_pntsSetBody)) {
+		printf("None point-set is found!\n");	return;
+	}
+	std::vector<int> keypoints;
+	PntsSetOperation::DetectISSKeypoints(_pDataBoard.m_pntsSetBody, keypoints);
+}
 
 extern void menuEvent(int idCommand);
 
@@ -88,6 +147,16 @@ extern void menuEvent(int idCommand);
 #endif
 
 
+void buildPickIndex()
+{
+	//	The picking under the cursor only uses a ready spatial index, which is built here,
+	//	once the points have changed, rather than by the first mouse motion over them
+	if (!(_pDataBoard.m_pntsSetBody)) return;
+	long time=clock();
+	_pDataBoard.m_pntsSetBody->GetPntsGrid();
+	printf("Spatial Index Time (ms): %ld\n",clock()-time);
+}
+
 void displayCoordinate(int x, int y)
 {
     double wx,wy,wz;
@@ -97,9 +166,27 @@ void displayCoordinate(int x, int y)
 	_pGLK.m_currentCoord[1]=(float)wy;
 	_pGLK.m_currentCoord[2]=(float)wz;
 
+	//	Report the point under the cursor, if any
+	_pGLK.m_currentPntIndex=-1;
+	PntsSetBody *pntsBody=_pDataBoard.m_pntsSetBody;
+	if (pntsBody && pntsBody->GetPntsNum()>0) {
+		double origin[3],dir[3],ex,ey,ez;
+		_pGLK.screen_to_ray(x, y, origin, dir);
+		_pGLK.screen_to_wcl(x+_PICK_TOLERANCE_PIXELS, y, ex, ey, ez);
+		float pickRadius=(float)sqrt((ex-wx)*(ex-wx)+(ey-wy)*(ey-wy)+(ez-wz)*(ez-wz));
+		int index=pntsBody->PickPoint(origin, dir, pickRadius);
+		if (index>=0) {
+			float *pos=pntsBody->GetPntPosArrayPtr()+index*3;
+			float *nv=pntsBody->GetNormalArrayPtr()+index*3;
+			_pGLK.m_currentPntIndex=index;
+			_pGLK.m_currentCoord[0]=pos[0];	_pGLK.m_currentCoord[1]=pos[1];	_pGLK.m_currentCoord[2]=pos[2];
+			_pGLK.m_currentNormal[0]=nv[0];	_pGLK.m_currentNormal[1]=nv[1];	_pGLK.m_currentNormal[2]=nv[2];
+		}
+	}
+
 //	printf("(%.2f, %.2f, %.2f)\n",(float)wx,(float)wy,(float)wz);
 
-	_pGLK.refresh();
+	_pGLK.Invalidate();
 }
 
 void specialKeyboardFunc(int key, int x, int y)
@@ -253,8 +340,34 @@ void mouseFunc(int button, int state, int x, int y)
 	}
 }
 
+void uploadScanFrame()
+{
+	//	The points of the newest frame of the live scanning move into the displayed point set,
+	//	whose vertex buffers are refilled rather than built anew for every frame
+	PntsSetBody *body=_pScanPipeline->BeginUpload();
+	if (body==NULL) return;
+	if (_pDataBoard.m_pntsSetBody) {
+		_pDataBoard.m_pntsSetBody->TakePoints(body);	delete body;
+		_pDataBoard.m_pntsSetBody->UpdateGLList();
+	}
+	else {
+		_pDataBoard.m_pntsSetBody=body;
+		body->BuildGLList(_pDataBoard.m_bPntNormalDisplay);
+		_pGLK.AddDisplayObj(body);
+	}
+	_pScanPipeline->EndUpload();
+	_pGLK.Invalidate();
+}
+
 void animationFunc()
 {
+	//	The event handlers only invalidate the view, which is drawn here at most once per
+	//	frame interval; waiting briefly otherwise keeps the idle loop from spinning
+	if (_pSnapshotWriter) _pSnapshotWriter->Poll();
+	if (_pScanPipeline && _pScanPipeline->IsRunning()) uploadScanFrame();
+	if (!_pGLK.RefreshIfInvalid())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
 /*	if (_pDataBoard.m_vdFieldCudaBody) {
 		int activeSlide=_pDataBoard.m_vdFieldCudaBody->GetActiveSlice();
 		activeSlide++;
@@ -471,20 +584,34 @@ void menuFuncFileSave()
 
 void menuFuncFileImageSnapShot()
 {
-//	int sx,sy;	_pGLK.GetSize(sx,sy);
-//	GLKAVIGenerator::SnapShot(sx, sy, "Data/Snapshot.bmp");
+	static int snapshotIndex=0;
+	if (_pSnapshotWriter==NULL) _pSnapshotWriter=new GLKSnapshotWriter;
+
+	//	The view is drawn again into the back buffer and read from there, the file being
+	//	written in the background while the window goes on
+	char filename[256];
+	sprintf(filename,"%sSnapshot%03d.png",CCL_DEFAULT_FOLDER_LOCATION,snapshotIndex++);
+	//	at full detail, as by runHeadless, rather than at the level of the last frame
+	PntsSetBody *pntsBody=_pDataBoard.m_pntsSetBody;
+	int lodPointBudget=(pntsBody)?(pntsBody->GetLODPointBudget()):0;
+	bool bInteracting=_pGLK.IsInteracting();
+	if (pntsBody) pntsBody->SetLODPointBudget(pntsBody->GetPntsNum());
+	_pGLK.SetInteracting(false);
+	int sx,sy;	_pGLK.GetSize(sx,sy);
+	_pGLK.SetOffscreen(true);	_pGLK.refresh();	_pGLK.SetOffscreen(false);
+	glReadBuffer(GL_BACK);
+	_pSnapshotWriter->Capture(sx,sy,filename);
+	if (pntsBody) pntsBody->SetLODPointBudget(lodPointBudget);
+	_pGLK.SetInteracting(bInteracting);
+	_pGLK.Invalidate();
+	printf("Snapshot: %s\n",filename);
 }
 
-void menuFuncFileOpen()
+bool loadPntsFile(char *filename)
 {
-    char filename[1024],exstr[4],name[256],directory[256];
-    
-    strcpy(directory,CCL_DEFAULT_FOLDER_LOCATION);
-    if (!fileChosenByList(directory,name)) return;
-    if (!isFileExist(directory,name)) return;
-    strcpy(filename,directory);	strcat(filename,name);
-    
+    char exstr[4];
     int length=(int)(strlen(filename));
+    if (length<3) return false;
     exstr[0]=filename[length-3];
     exstr[1]=filename[length-2];
     exstr[2]=filename[length-1];
@@ -497,84 +624,49 @@ void menuFuncFileOpen()
 			_pGLK.DelDisplayObj2(_pDataBoard.m_pntsSetBody);
 
 		long time=clock();
-		if (strcmp(exstr,"obj")==0) {
-			if (!(_pDataBoard.m_pntsSetBody->ImportOBJFile(filename))) { delete (_pDataBoard.m_pntsSetBody);	return; }
-		}
-		if (strcmp(exstr,"pwn")==0) {
-			if (!(_pDataBoard.m_pntsSetBody->ImportPWNFile(filename))) { delete (_pDataBoard.m_pntsSetBody);	return; }
-		}
+		bool bImported=(strcmp(exstr,"obj")==0) ? _pDataBoard.m_pntsSetBody->ImportOBJFile(filename)
+			: _pDataBoard.m_pntsSetBody->ImportPWNFile(filename);
+		if (!bImported) { delete (_pDataBoard.m_pntsSetBody);	_pDataBoard.m_pntsSetBody=NULL;	return false; }
 		printf("OBJ File Import Time (ms): %ld\n",clock()-time); time=clock();
+		char indexFilename[1024];
+		sprintf(indexFilename,"%s.idx",filename);
+		_pDataBoard.m_pntsSetBody->SetIndexFileName(indexFilename);
 		_pDataBoard.m_pntsSetBody->CompRange();
 		_pDataBoard.m_pntsSetBody->BuildGLList(_pDataBoard.m_bPntNormalDisplay);
 		printf("--------------------------------------------\n");
 		_pGLK.AddDisplayObj(_pDataBoard.m_pntsSetBody, true);
 		printf("Build GL List Time (ms): %ld\n",clock()-time); time=clock();
+		return true;
 	}
+	return false;
+}
+
+void menuFuncFileOpen()
+{
+    char filename[1024],name[256],directory[256];
+    
+    strcpy(directory,CCL_DEFAULT_FOLDER_LOCATION);
+    if (!fileChosenByList(directory,name)) return;
+    if (!isFileExist(directory,name)) return;
+    strcpy(filename,directory);	strcat(filename,name);
+    
+    if (loadPntsFile(filename)) buildPickIndex();
 }
 
 void menuFuncCaptureRealsense()
 {
-    // Turn on logging. We can separately enable logging to console or to file, and use different severity filters for each.
-    rs::log_to_console(rs::log_severity::warn);
-    //rs::log_to_file(rs::log_severity::debug, "librealsense.log");
+    // The device is opened and warmed up by the first capture only, and keeps streaming
+    // in the background for the next ones, which take its newest frame
+    if (!_pCaptureDevice) _pCaptureDevice = new PntsCaptureDevice;
+    if (!_pCaptureDevice->Start()) return;
 
-    printf("Starting Real Sense stuff...\n");
     long time=clock();
-    
-    // Create a context object. This object owns the handles to all connected realsense devices.
-    rs::context ctx;
-    printf("There are %d connected RealSense devices.\n", ctx.get_device_count());
-    if(ctx.get_device_count() == 0) std::exit(1);
-
-    // This tutorial will access only a single device, but it is trivial to extend to multiple devices
-    rs::device * dev = ctx.get_device(0);
-    printf("\nUsing device 0, an %s\n", dev->get_name());
-    printf("    Serial number: %s\n", dev->get_serial());
-    printf("    Firmware version: %s\n", dev->get_firmware_version());
-
-    // Configure depth and color to run with the device's preferred settings
-    dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
-    dev->enable_stream(rs::stream::color, rs::preset::best_quality);
-    dev->start();
-
-    // Camera warmup - Dropped several first frames to let auto-exposure stabilize
-    for (int i = 0; i < 30; i++)
-    {
-        dev->wait_for_frames();
-    }
-    
-//     const uint8_t * color_data = (const uint8_t*)dev->get_frame_data(rs::stream::color);
-    const uint16_t * depth_image = (const uint16_t*)dev->get_frame_data(rs::stream::depth);
-
-    // Retrieve camera parameters for mapping between depth and color
-    rs::intrinsics depth_intrin = dev->get_stream_intrinsics(rs::stream::depth);
-//     rs::extrinsics depth_to_color = dev->get_extrinsics(rs::stream::depth, rs::stream::color);
-//     rs::intrinsics color_intrin = dev->get_stream_intrinsics(rs::stream::color);
-    float scale = dev->get_depth_scale();
-    
+    PntsDepthFrame frame;
+    if (!_pCaptureDevice->GetNewestFrame(frame)) {printf("No frame has arrived from the RealSense device!\n");	return;}
+
     std::vector<rs::float3> scan_points;
-    scan_points.reserve(depth_intrin.height * depth_intrin.width);
-    
-    for(int dy=0; dy<depth_intrin.height; ++dy)
-    {
-        for(int dx=0; dx<depth_intrin.width; ++dx)
-        {
-            // Retrieve the 16-bit depth value and map it into a depth in meters
-            uint16_t depth_value = depth_image[dy * depth_intrin.width + dx];
-            float depth_in_meters = depth_value * scale;
-
-            // Skip over pixels with a depth value of zero, which is used to indicate no data
-            if(depth_value == 0) continue;
-
-            // Map from pixel coordinates in the depth image to pixel coordinates in the color image
-            rs::float2 depth_pixel = {(float)dx, (float)dy};
-            rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
-//             rs::float3 color_point = depth_to_color.transform(depth_point);
-//             rs::float2 color_pixel = color_intrin.project(color_point);
-            constexpr float scaling = 10;
-            scan_points.emplace_back(rs::float3{depth_point.x * scaling, depth_point.y*scaling, depth_point.z*scaling});
-        }
-    }
+    std::vector<int> pixel_to_point;
+    PntsCaptureDevice::Deproject(frame, 10, scan_points, pixel_to_point);
     
         
     // set data to the data obtained from real sense
@@ -582,7 +674,7 @@ void menuFuncCaptureRealsense()
         _pDataBoard.m_pntsSetBody = new PntsSetBody;
     else
         _pGLK.DelDisplayObj2(_pDataBoard.m_pntsSetBody);
-    _pDataBoard.m_pntsSetBody->setData(scan_points);
+    _pDataBoard.m_pntsSetBody->setData(scan_points, frame.width, frame.height, pixel_to_point);
     
     printf("Captured %li points in %ld ms\n", scan_points.size(), clock()-time); time=clock();
     
@@ -593,23 +685,35 @@ void menuFuncCaptureRealsense()
     printf("Build GL List Time (ms): %ld\n", clock()-time); time=clock();
     
     // COMPUTE NORMALS
+    // Neighbors are adjacent pixels of the depth image, which also gives the
+    // viewing direction to orient the normals towards the camera.
     std::cerr << "Computing normals...\n";
-    rs::float3 camera_direction;
-    {
-        rs::float2 middle = {float(depth_intrin.width) * .5f, float(depth_intrin.height) * .5f};
-        rs::float3 depth_point = depth_intrin.deproject(middle, 10);
-        rs::float3 deeper_point = depth_intrin.deproject(middle, 20);
-        camera_direction = {depth_point.x - deeper_point.x, depth_point.y - deeper_point.y, depth_point.z - deeper_point.z};
-    }
-    _pDataBoard.m_pntsSetBody->calculateNormals(true);
-    _pDataBoard.m_pntsSetBody->alignNormals(camera_direction.x, camera_direction.y, camera_direction.z);
+    _pDataBoard.m_pntsSetBody->calculateOrganizedNormals(3, true);
     std::cerr << "Done computing normals in "<< (clock()-time) << "s.\n"; time=clock();
     
+    buildPickIndex();
     _pGLK.refresh();
 }
 
+void menuFuncCaptureLiveScan()
+{
+    // Toggled; the statistics of the stages are printed when it stops
+    if (_pScanPipeline && _pScanPipeline->IsRunning()) {
+        _pScanPipeline->Stop();
+        _pScanPipeline->PrintStats();
+        buildPickIndex();
+        return;
+    }
+    if (!_pCaptureDevice) _pCaptureDevice = new PntsCaptureDevice;
+    if (!_pScanPipeline) _pScanPipeline = new PntsScanPipeline(_pCaptureDevice);
+    if (_pScanPipeline->Start()) printf("Live scanning started\n");
+}
+
 void menuFuncQuit()
 {
+	if (_pScanPipeline) delete _pScanPipeline;
+	if (_pSnapshotWriter) {_pSnapshotWriter->ClearAll();	delete _pSnapshotWriter;}
+	if (_pCaptureDevice) delete _pCaptureDevice;
 	exit(0);
 }
 
@@ -618,11 +722,7 @@ void menuFuncPntsMakeCenter()
 	if (!(_pDataBoard.m_pntsSetBody))  {printf("None point-set is found!\n");	return;}
 
 	PntsSetOperation::MakeCenter(_pDataBoard.m_pntsSetBody);
-
-	printf("--------------------------------------------\n");
-	long time = clock();
-	_pDataBoard.m_pntsSetBody->BuildGLList(_pDataBoard.m_bPntNormalDisplay);
-	printf("Build GL List Time (ms): %ld\n", clock() - time); time = clock();
+	buildPickIndex();
 	_pGLK.refresh();
 }
 
@@ -659,6 +759,9 @@ void menuEvent(int idCommand)
     case _MENU_CAPTURE_REALSENSE:
         menuFuncCaptureRealsense();
         break;
+    case _MENU_CAPTURE_LIVESCAN:
+        menuFuncCaptureLiveScan();
+        break;
 	case _MENU_FILE_SAVE:menuFuncFileSave();
 		break;
 
@@ -716,10 +819,12 @@ void menuEvent(int idCommand)
 	}break;
 	case _MENU_VIEW_COORD:{_pGLK.m_bCoordDisp = !(_pGLK.m_bCoordDisp); _pGLK.refresh();
 	}break;
+	case _MENU_VIEW_FRAMESTATS:{_pGLK.SetFrameStatsDisplay(!(_pGLK.GetFrameStatsDisplay())); _pGLK.refresh();
+	}break;
 	case _MENU_VIEW_PNTNORMALVECDISP:{		
 										 		if (_pDataBoard.m_pntsSetBody) {
 													 _pDataBoard.m_bPntNormalDisplay=!(_pDataBoard.m_bPntNormalDisplay);
-													 _pDataBoard.m_pntsSetBody->BuildGLList(_pDataBoard.m_bPntNormalDisplay);
+													 _pDataBoard.m_pntsSetBody->SetNormalArrowDisplay(_pDataBoard.m_bPntNormalDisplay);
 													 _pGLK.SetProfile(true);
 													 _pGLK.refresh();
 													 }
@@ -730,6 +835,49 @@ void menuEvent(int idCommand)
 												 _pDataBoard.m_pntsSetBody->SetLighting(!bLight);	_pGLK.refresh();
 												 }
 	}break;
+	case _MENU_VIEW_NORMALARROWLONGER:
+	case _MENU_VIEW_NORMALARROWSHORTER:{
+									 		if (_pDataBoard.m_pntsSetBody) {
+												 float length=_pDataBoard.m_pntsSetBody->GetNormalArrowLength();
+												 length*=(idCommand==_MENU_VIEW_NORMALARROWLONGER)?1.5f:(1.0f/1.5f);
+												 _pDataBoard.m_pntsSetBody->SetNormalArrowLength(length);	_pGLK.refresh();
+												 }
+	}break;
+	case _MENU_VIEW_NORMALARROWDENSER:
+	case _MENU_VIEW_NORMALARROWSPARSER:{
+									 		if (_pDataBoard.m_pntsSetBody) {
+												 int stride=_pDataBoard.m_pntsSetBody->GetNormalArrowStride();
+												 stride=(idCommand==_MENU_VIEW_NORMALARROWDENSER)?stride/2:stride*2;
+												 _pDataBoard.m_pntsSetBody->SetNormalArrowStride(stride);	_pGLK.refresh();
+												 }
+	}break;
+	case _MENU_VIEW_OCCLUSIONCULLING:{
+									 		if (_pDataBoard.m_pntsSetBody) {
+												 bool bCulling=_pDataBoard.m_pntsSetBody->GetOcclusionCulling();
+												 _pDataBoard.m_pntsSetBody->SetOcclusionCulling(!bCulling);	_pGLK.refresh();
+												 }
+	}break;
+	case _MENU_VIEW_COLORATTRIBUTE:{
+									 		if (_pDataBoard.m_pntsSetBody) {
+												 //	Step through the plain color and every component of every channel
+												 PntsSetBody *body=_pDataBoard.m_pntsSetBody;
+												 const char *name=body->GetColorAttribute();
+												 int index=-1,component=body->GetColorAttributeComponent()+1,components=0;
+												 for(int i=0;name!=NULL && i<body->GetAttributeNum();i++)
+													 if (strcmp(body->GetAttributeName(i),name)==0) index=i;
+												 if (index>=0) body->GetAttribute(name,&components);
+												 if (index<0 || component>=components) {index++;	component=0;}
+												 if (index>=body->GetAttributeNum()) {
+													 body->SetColorAttribute(NULL);	printf("Points colored plainly\n");
+												 }
+												 else {
+													 body->SetColorAttribute(body->GetAttributeName(index),component);
+													 float minValue,maxValue;	body->GetColorRange(minValue,maxValue);
+													 printf("Points colored by %s[%d] from %f to %f\n",body->GetAttributeName(index),component,minValue,maxValue);
+												 }
+												 _pGLK.refresh();
+												 }
+	}break;
 	case _MENU_VIEW_SNAPSHOT:menuFuncFileImageSnapShot();
 		break;
 
@@ -739,6 +887,14 @@ void menuEvent(int idCommand)
 		break;
 	case _MENU_PNTS_MAKECENTER:menuFuncPntsMakeCenter();
 		break;
+	case _MENU_PNTS_MSTNORMALORIENT:menuFuncPntsMSTNormalOrientation();
+		break;
+	case _MENU_PNTS_MULTISCALEFEATURE:menuFuncPntsMultiScaleFeatures();
+		break;
+	case _MENU_PNTS_FPFH:menuFuncPntsFPFH();
+		break;
+	case _MENU_PNTS_ISSKEYPOINT:menuFuncPntsISSKeypoints();
+		break;
 	}
 }
 
@@ -750,6 +906,7 @@ int buildPopupMenu (void)
 	glutAddMenuEntry("Open\tCtrl+O", _MENU_FILE_OPEN);
 	glutAddMenuEntry("Save\tCtrl+S", _MENU_FILE_SAVE);
 	glutAddMenuEntry("Capture RealSense\tCtrl+C", _MENU_CAPTURE_REALSENSE);
+	glutAddMenuEntry("Live Scanning with RealSense", _MENU_CAPTURE_LIVESCAN);
 
 	viewSubMenu = glutCreateMenu(menuEvent);
 	glutAddMenuEntry("Isometric", _MENU_VIEW_ISOMETRIC);
@@ -772,14 +929,25 @@ int buildPopupMenu (void)
 	glutAddMenuEntry("----",-1);
 	glutAddMenuEntry("Axis Frame",_MENU_VIEW_AXIS);
 	glutAddMenuEntry("Coordinate",_MENU_VIEW_COORD);
+	glutAddMenuEntry("Frame Time Statistics",_MENU_VIEW_FRAMESTATS);
 	glutAddMenuEntry("----",-1);
 	glutAddMenuEntry("Point-Cloud Normal Vector",_MENU_VIEW_PNTNORMALVECDISP);
+	glutAddMenuEntry("Normal Vector Longer",_MENU_VIEW_NORMALARROWLONGER);
+	glutAddMenuEntry("Normal Vector Shorter",_MENU_VIEW_NORMALARROWSHORTER);
+	glutAddMenuEntry("Normal Vector Denser",_MENU_VIEW_NORMALARROWDENSER);
+	glutAddMenuEntry("Normal Vector Sparser",_MENU_VIEW_NORMALARROWSPARSER);
 	glutAddMenuEntry("Point-Cloud Shading with Light\tCtrl+L",_MENU_VIEW_PNTSLIGHTING);
+	glutAddMenuEntry("Point-Cloud Occlusion Culling",_MENU_VIEW_OCCLUSIONCULLING);
+	glutAddMenuEntry("Point-Cloud Color by Next Attribute",_MENU_VIEW_COLORATTRIBUTE);
 	glutAddMenuEntry("----",-1);
 	glutAddMenuEntry("Image Snap Shot\tCtrl+Z",_MENU_VIEW_SNAPSHOT);
 
 	pntsSubMenu = glutCreateMenu(menuEvent);
 	glutAddMenuEntry("PCA-based Normal Evaluation", _MENU_PNTS_PCANORMALEVA);
+	glutAddMenuEntry("MST-based Normal Orientation", _MENU_PNTS_MSTNORMALORIENT);
+	glutAddMenuEntry("Multi-scale Geometric Features", _MENU_PNTS_MULTISCALEFEATURE);
+	glutAddMenuEntry("FPFH Descriptors", _MENU_PNTS_FPFH);
+	glutAddMenuEntry("ISS Keypoints", _MENU_PNTS_ISSKEYPOINT);
 	glutAddMenuEntry("----", -1);
 	glutAddMenuEntry("Voronoi-Diagram Field Construction", _MENU_PNTS_VDFIELDCONSTRUCT);
 	glutAddMenuEntry("Medial-Axis Approximation", _MENU_PNTS_MEDIALAXISAPPROX);
@@ -796,10 +964,73 @@ int buildPopupMenu (void)
 	return mainMenu;
 }
 
+//---------------------------------------------------------------------------------
+//	Rendering without any window, e.g. for thumbnails on a server:
+//		PntWorks_bin --headless <file.obj|file.pwn> [--size WxH] [--views N] [--output prefix]
+//	writes prefix.png, or N views turning around the vertical axis as prefix_000.png,
+//	prefix_001.png, ...
+int runHeadless(int argc, char *argv[])
+{
+	char *inputFile=NULL;	const char *outputPrefix=CCL_DEFAULT_FOLDER_LOCATION "Snapshot";
+	int width=800, height=600, viewNum=1;
+	for(int i=2;i<argc;i++) {
+		if (strcmp(argv[i],"--size")==0 && i+1<argc) {
+			if (sscanf(argv[++i],"%dx%d",&width,&height)!=2) width=0;
+		}
+		else if (strcmp(argv[i],"--views")==0 && i+1<argc) viewNum=atoi(argv[++i]);
+		else if (strcmp(argv[i],"--output")==0 && i+1<argc) outputPrefix=argv[++i];
+		else if (inputFile==NULL) inputFile=argv[i];
+		else {printf("Unknown argument: %s\n",argv[i]);	return 1;}
+	}
+	if (inputFile==NULL || width<=0 || height<=0 || viewNum<1) {
+		printf("Usage: %s --headless <file.obj|file.pwn> [--size WxH] [--views N] [--output prefix]\n",argv[0]);
+		return 1;
+	}
+
+	GLKOffscreenContext context;
+	if (!context.Create(width,height)) return 1;
+	printf("Offscreen rendering by %s at %d x %d\n",GLKOffscreenContext::GetBackendName(),width,height);
+
+	_pGLK.SetOffscreen(true);
+	initFunc();
+	_pGLK.Reshape(width,height);
+	_pGLK.SetClearColor(0.35f,0.35f,0.35f);
+	_pGLK.SetForegroundColor(1.0f,1.0f,1.0f);
+	_pGLK.SetProfile(false);
+	if (!loadPntsFile(inputFile)) {printf("%s could not be loaded!\n",inputFile);	return 1;}
+	//	Every view at full detail, in a single frame
+	_pDataBoard.m_pntsSetBody->SetLODPointBudget(_pDataBoard.m_pntsSetBody->GetPntsNum());
+	_pGLK.zoom_all_in_view();
+
+	//	The readback and encoding of a view overlap with the drawing of the next ones
+	GLKSnapshotWriter writer;
+	float xR,yR;	_pGLK.GetRotation(xR,yR);
+	std::chrono::steady_clock::time_point startTime=std::chrono::steady_clock::now();
+	char filename[1024];
+	for(int i=0;i<viewNum;i++) {
+		_pGLK.SetRotation(xR,yR+360.0f*(float)i/(float)viewNum);
+		_pGLK.refresh();
+		if (viewNum==1) sprintf(filename,"%s.png",outputPrefix);
+		else sprintf(filename,"%s_%03d.png",outputPrefix,i);
+		writer.Capture(width,height,filename);
+		writer.Poll();
+	}
+	writer.ClearAll();
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+	printf("%d snapshots written in %.2f s (%.1f per second)\n",writer.GetWrittenNum(),seconds,
+		(seconds>0.0)?writer.GetWrittenNum()/seconds:0.0);
+
+	//	The point set owns GL buffers, which go with the context
+	_pGLK.ClearAll();	_pDataBoard.m_pntsSetBody=NULL;
+	return (writer.GetFailedNum()==0)?0:1;
+}
+
 //---------------------------------------------------------------------------------
 //	The major function of a program
 int main(int argc, char *argv[])
 {
+	if (argc>1 && strcmp(argv[1],"--headless")==0) return runHeadless(argc,argv);
+
     { // glut Frame
         glutInit(&argc, argv);
     //    glutInitDisplayMode(GLUT_DEPTH | GLUT_RGB | GLUT_DOUBLE | GLUT_MULTISAMPLE | GLUT_STENCIL);
@@ -826,8 +1057,6 @@ int main(int argc, char *argv[])
 
         displayFunc();
         
-    #if defined (__linux__)
-    #else
         if(glewInit() != GLEW_OK) {
             printf("glewInit failed. Exiting...\n");
             return false;
@@ -841,7 +1070,6 @@ int main(int argc, char *argv[])
             printf("OpenGL 2.0 not supported\n");
             return false;
         }
-    #endif
         
         printf("PntWorks Started\n");
         printf("--------------------------------------------------\n");
@@ -0,0 +1,165 @@
+#ifndef UTILS_DISTANCE_KERNELS_H
+#define UTILS_DISTANCE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTILS_DISTANCE_KERNELS_X86
+#endif
+
+namespace cura {
+
+/*! \brief Kernels filtering many points by their squared distance to one query point.
+ *
+ * The points are given as separate x, y and z arrays (as stored per cell by
+ * PointIndexGrid).  Each kernel has a scalar version and, on x86, SSE and
+ * AVX2 versions that handle 4 or 8 points per instruction.  The version is
+ * chosen once at runtime from the CPU features.  All versions compute
+ * dx*dx + dy*dy + dz*dz with the same float operations in the same order,
+ * so they return identical results.
+ */
+namespace DistanceKernels {
+
+/*! \brief Signature of filterWithin. */
+typedef size_t (*FilterWithinFunc)(const float* xs, const float* ys, const float* zs, size_t n,
+                                   float qx, float qy, float qz, float max_dist2,
+                                   uint32_t* offsets, float* dist2);
+
+inline size_t filterWithinScalar(const float* xs, const float* ys, const float* zs, size_t n,
+                                 float qx, float qy, float qz, float max_dist2,
+                                 uint32_t* offsets, float* dist2)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        float dx = xs[i] - qx;
+        float dy = ys[i] - qy;
+        float dz = zs[i] - qz;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 <= max_dist2)
+        {
+            offsets[count] = (uint32_t)i;
+            dist2[count] = d2;
+            count++;
+        }
+    }
+    return count;
+}
+
+#ifdef UTILS_DISTANCE_KERNELS_X86
+
+__attribute__((target("sse2")))
+inline size_t filterWithinSSE(const float* xs, const float* ys, const float* zs, size_t n,
+                              float qx, float qy, float qz, float max_dist2,
+                              uint32_t* offsets, float* dist2)
+{
+    const __m128 vqx = _mm_set1_ps(qx), vqy = _mm_set1_ps(qy), vqz = _mm_set1_ps(qz);
+    const __m128 vmax = _mm_set1_ps(max_dist2);
+    size_t count = 0;
+    size_t i = 0;
+    float d2s[4];
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), vqx);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), vqy);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), vqz);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, vmax));
+        if (mask == 0) continue;
+        _mm_storeu_ps(d2s, d2);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (mask & (1 << lane))
+            {
+                offsets[count] = (uint32_t)(i + lane);
+                dist2[count] = d2s[lane];
+                count++;
+            }
+        }
+    }
+    size_t tail = filterWithinScalar(xs + i, ys + i, zs + i, n - i, qx, qy, qz, max_dist2, offsets + count, dist2 + count);
+    for (size_t j = count; j < count + tail; j++)
+    {
+        offsets[j] += (uint32_t)i;
+    }
+    return count + tail;
+}
+
+__attribute__((target("avx2")))
+inline size_t filterWithinAVX2(const float* xs, const float* ys, const float* zs, size_t n,
+                               float qx, float qy, float qz, float max_dist2,
+                               uint32_t* offsets, float* dist2)
+{
+    const __m256 vqx = _mm256_set1_ps(qx), vqy = _mm256_set1_ps(qy), vqz = _mm256_set1_ps(qz);
+    const __m256 vmax = _mm256_set1_ps(max_dist2);
+    size_t count = 0;
+    size_t i = 0;
+    float d2s[8];
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vqx);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vqy);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), vqz);
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, vmax, _CMP_LE_OQ));
+        if (mask == 0) continue;
+        _mm256_storeu_ps(d2s, d2);
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            offsets[count] = (uint32_t)(i + lane);
+            dist2[count] = d2s[lane];
+            count++;
+        }
+    }
+    size_t tail = filterWithinSSE(xs + i, ys + i, zs + i, n - i, qx, qy, qz, max_dist2, offsets + count, dist2 + count);
+    for (size_t j = count; j < count + tail; j++)
+    {
+        offsets[j] += (uint32_t)i;
+    }
+    return count + tail;
+}
+
+#endif // UTILS_DISTANCE_KERNELS_X86
+
+/*! \brief Whether the CPU supports AVX2. */
+inline bool hasAVX2()
+{
+#ifdef UTILS_DISTANCE_KERNELS_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+/*! \brief Finds the points within squared distance \p max_dist2 of (\p qx, \p qy, \p qz).
+ *
+ * This is the filter in front of a top-k selection: passing the current
+ * k-th distance as \p max_dist2 leaves only the points that can still
+ * enter the selection.
+ *
+ * \param[out] offsets The offsets (0 to n-1) of the points found, room for \p n.
+ * \param[out] dist2 The squared distances of the points found, room for \p n.
+ * \return The number of points found.
+ */
+inline size_t filterWithin(const float* xs, const float* ys, const float* zs, size_t n,
+                           float qx, float qy, float qz, float max_dist2,
+                           uint32_t* offsets, float* dist2)
+{
+#ifdef UTILS_DISTANCE_KERNELS_X86
+    static const FilterWithinFunc func = hasAVX2() ? filterWithinAVX2 : filterWithinSSE;
+#else
+    static const FilterWithinFunc func = filterWithinScalar;
+#endif
+    return func(xs, ys, zs, n, qx, qy, qz, max_dist2, offsets, dist2);
+}
+
+} // namespace DistanceKernels
+
+} // namespace cura
+
+#endif // UTILS_DISTANCE_KERNELS_H
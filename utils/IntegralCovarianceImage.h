@@ -0,0 +1,173 @@
+#ifndef UTILS_INTEGRAL_COVARIANCE_IMAGE_H
+#define UTILS_INTEGRAL_COVARIANCE_IMAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "NormalKernels.h"
+#include "ThreadPool.h"
+
+namespace cura {
+
+/*! \brief Integral images of the coordinates and coordinate products of an organized point cloud.
+ *
+ * An organized cloud stores one point per pixel of a depth image, with
+ * invalid pixels where the sensor saw nothing.  After one pass over the
+ * image the count, mean and covariance of the valid points in any
+ * axis-aligned pixel rectangle follow from four lookups, independent of
+ * the size of the rectangle.
+ *
+ * The sums are accumulated in double precision relative to the mean of all
+ * valid points, which keeps the cancellation in the covariance small.
+ */
+class IntegralCovarianceImage
+{
+public:
+    IntegralCovarianceImage() : m_width(0), m_height(0) {}
+
+    /*! \brief Builds the integral images.
+     *
+     * \param[in] pos_array The point coordinates, three floats per point.
+     * \param[in] pixel_to_point The point index of each pixel, row by row, -1 for invalid pixels.
+     * \param[in] width The width of the image.
+     * \param[in] height The height of the image.
+     */
+    void build(const float* pos_array, const int* pixel_to_point, int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        const size_t stride = width + 1;
+        m_sums.assign(stride * (height + 1), Sums());
+
+        // Reference point: the mean of the valid points
+        double ref[3] = { 0, 0, 0 };
+        size_t valid_count = 0;
+        for (size_t pixel = 0; pixel < size_t(width) * height; pixel++)
+        {
+            if (pixel_to_point[pixel] < 0) continue;
+            const float* p = pos_array + size_t(pixel_to_point[pixel]) * 3;
+            ref[0] += p[0]; ref[1] += p[1]; ref[2] += p[2];
+            valid_count++;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            m_ref[axis] = valid_count ? ref[axis] / valid_count : 0;
+        }
+
+        // Prefix sums along each row, rows in parallel; a few rows at a time, since an image
+        // has fewer rows than the default grain of parallelFor
+        ThreadPool::instance().parallelFor(height, 4,
+            [this, pos_array, pixel_to_point, width, stride](size_t y_begin, size_t y_end, unsigned int)
+            {
+                for (size_t y = y_begin; y < y_end; y++)
+                {
+                    Sums running;
+                    Sums* row = &m_sums[(y + 1) * stride];
+                    for (int x = 0; x < width; x++)
+                    {
+                        int point_idx = pixel_to_point[y * width + x];
+                        if (point_idx >= 0)
+                        {
+                            const float* p = pos_array + size_t(point_idx) * 3;
+                            running.add(p[0] - m_ref[0], p[1] - m_ref[1], p[2] - m_ref[2]);
+                        }
+                        row[x + 1] = running;
+                    }
+                }
+            });
+
+        // Prefix sums down each column, blocks of columns in parallel
+        const size_t column_block = 64;
+        parallelForChunks(stride, unsigned((stride + column_block - 1) / column_block),
+            [this, height, stride](unsigned int, size_t x_begin, size_t x_end)
+            {
+                for (int y = 1; y < height; y++)
+                {
+                    const Sums* above = &m_sums[y * stride];
+                    Sums* row = &m_sums[(y + 1) * stride];
+                    for (size_t x = x_begin; x < x_end; x++)
+                    {
+                        row[x] += above[x];
+                    }
+                }
+            });
+    }
+
+    /*! \brief The mean and covariance of the valid points in the pixel rectangle [x0, x1) x [y0, y1).
+     *
+     * The rectangle is clipped to the image.
+     *
+     * \param[out] cov The mean and sample covariance.
+     * \return The number of valid points in the rectangle.
+     */
+    size_t getCovariance(int x0, int y0, int x1, int y1, NormalKernels::Covariance& cov) const
+    {
+        x0 = std::max(0, x0); y0 = std::max(0, y0);
+        x1 = std::min(m_width, x1); y1 = std::min(m_height, y1);
+        if (x0 >= x1 || y0 >= y1)
+        {
+            cov = NormalKernels::Covariance();
+            return 0;
+        }
+        const size_t stride = m_width + 1;
+        Sums s = m_sums[y1 * stride + x1];
+        s -= m_sums[y0 * stride + x1];
+        s -= m_sums[y1 * stride + x0];
+        s += m_sums[y0 * stride + x0];
+
+        const double n = std::max(s.n, 1.0);
+        const double norm = std::max(s.n, 2.0) - 1;
+        const double mx = s.x / n, my = s.y / n, mz = s.z / n;
+        cov.mean[0] = float(m_ref[0] + mx);
+        cov.mean[1] = float(m_ref[1] + my);
+        cov.mean[2] = float(m_ref[2] + mz);
+        cov.xx = float((s.xx - s.x * mx) / norm);
+        cov.xy = float((s.xy - s.x * my) / norm);
+        cov.xz = float((s.xz - s.x * mz) / norm);
+        cov.yy = float((s.yy - s.y * my) / norm);
+        cov.yz = float((s.yz - s.y * mz) / norm);
+        cov.zz = float((s.zz - s.z * mz) / norm);
+        return size_t(s.n);
+    }
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+
+private:
+    struct Sums
+    {
+        double n, x, y, z, xx, xy, xz, yy, yz, zz;
+
+        Sums() : n(0), x(0), y(0), z(0), xx(0), xy(0), xz(0), yy(0), yz(0), zz(0) {}
+
+        void add(double px, double py, double pz)
+        {
+            n += 1;
+            x += px; y += py; z += pz;
+            xx += px * px; xy += px * py; xz += px * pz;
+            yy += py * py; yz += py * pz; zz += pz * pz;
+        }
+        Sums& operator+=(const Sums& b)
+        {
+            n += b.n; x += b.x; y += b.y; z += b.z;
+            xx += b.xx; xy += b.xy; xz += b.xz; yy += b.yy; yz += b.yz; zz += b.zz;
+            return *this;
+        }
+        Sums& operator-=(const Sums& b)
+        {
+            n -= b.n; x -= b.x; y -= b.y; z -= b.z;
+            xx -= b.xx; xy -= b.xy; xz -= b.xz; yy -= b.yy; yz -= b.yz; zz -= b.zz;
+            return *this;
+        }
+    };
+
+    int m_width;
+    int m_height;
+    double m_ref[3];
+    std::vector<Sums> m_sums; //!< (width + 1) x (height + 1), the first row and column are zero
+};
+
+} // namespace cura
+
+#endif // UTILS_INTEGRAL_COVARIANCE_IMAGE_H
@@ -0,0 +1,104 @@
+#ifndef UTILS_MAPPED_FILE_H
+#define UTILS_MAPPED_FILE_H
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UTILS_MAPPED_FILE_MMAP
+#endif
+
+namespace cura {
+
+/*! \brief Read-only view of a whole file.
+ *
+ * The file is memory mapped where mmap is available, so its pages are only
+ * read from disk when they are touched.  Elsewhere the file is read into
+ * memory.
+ */
+class MappedFile
+{
+public:
+    MappedFile() : m_data(nullptr), m_size(0) {}
+    ~MappedFile() { close(); }
+
+    /*! \brief Maps the file \p filename.
+     *
+     * \return Whether the file could be opened.
+     */
+    bool open(const char* filename)
+    {
+        close();
+#ifdef UTILS_MAPPED_FILE_MMAP
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) return false;
+        m_data = static_cast<const char*>(data);
+        m_size = st.st_size;
+        return true;
+#else
+        FILE* fp = fopen(filename, "rb");
+        if (!fp) return false;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (size <= 0)
+        {
+            fclose(fp);
+            return false;
+        }
+        m_buffer.resize(size);
+        bool ok = fread(&m_buffer[0], 1, size, fp) == size_t(size);
+        fclose(fp);
+        if (!ok)
+        {
+            m_buffer.clear();
+            return false;
+        }
+        m_data = &m_buffer[0];
+        m_size = size;
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef UTILS_MAPPED_FILE_MMAP
+        if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#else
+        std::vector<char>().swap(m_buffer);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_data;
+    size_t m_size;
+#ifndef UTILS_MAPPED_FILE_MMAP
+    std::vector<char> m_buffer;
+#endif
+};
+
+} // namespace cura
+
+#endif // UTILS_MAPPED_FILE_H
@@ -0,0 +1,529 @@
+#ifndef UTILS_NORMAL_KERNELS_H
+#define UTILS_NORMAL_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "DistanceKernels.h"
+
+namespace cura {
+
+/*! \brief Kernels for estimating normals by principal component analysis of point neighborhoods.
+ *
+ * The covariance of a neighborhood is accumulated directly from the
+ * neighbor indices into a handful of scalars, and its eigen decomposition
+ * is computed in closed form, so nothing is allocated per point.  The
+ * covariance also has a batch version which, on CPUs with AVX2, handles 8
+ * neighborhoods at once.  It performs the same float operations per
+ * neighborhood as the scalar version and so gives identical results.  The
+ * eigen decomposition has one as well, handling 4 covariances at once in
+ * double precision; its acos and cos are polynomials, so it agrees with the
+ * scalar version up to rounding.
+ */
+namespace NormalKernels {
+
+/*! \brief The mean and covariance of a set of points. */
+struct Covariance
+{
+    float mean[3];
+    float xx, xy, xz, yy, yz, zz;
+};
+
+/*! \brief Computes the mean and sample covariance of the points \p indices refers to.
+ *
+ * \param[in] pos_array The point coordinates, three floats per point.
+ * \param[in] indices The indices of the points.
+ * \param[in] n The number of indices.
+ * \param[out] cov The result. All zero when \p n is 0.
+ */
+inline void computeCovariance(const float* pos_array, const uint32_t* indices, size_t n, Covariance& cov)
+{
+    float sx = 0, sy = 0, sz = 0;
+    for (size_t j = 0; j < n; j++)
+    {
+        const float* p = pos_array + size_t(indices[j]) * 3;
+        sx += p[0];
+        sy += p[1];
+        sz += p[2];
+    }
+    const float count = float(std::max(n, size_t(1)));
+    const float mx = sx / count, my = sy / count, mz = sz / count;
+
+    float xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0;
+    for (size_t j = 0; j < n; j++)
+    {
+        const float* p = pos_array + size_t(indices[j]) * 3;
+        float dx = p[0] - mx;
+        float dy = p[1] - my;
+        float dz = p[2] - mz;
+        xx += dx * dx;
+        xy += dx * dy;
+        xz += dx * dz;
+        yy += dy * dy;
+        yz += dy * dz;
+        zz += dz * dz;
+    }
+    const float norm = float(std::max(n, size_t(2)) - 1);
+    cov.mean[0] = mx;
+    cov.mean[1] = my;
+    cov.mean[2] = mz;
+    cov.xx = xx / norm;
+    cov.xy = xy / norm;
+    cov.xz = xz / norm;
+    cov.yy = yy / norm;
+    cov.yz = yz / norm;
+    cov.zz = zz / norm;
+}
+
+/*! \brief Signature of computeCovariances. */
+typedef void (*ComputeCovariancesFunc)(const float* pos_array, const uint32_t* indices, const uint32_t* offsets,
+                                       size_t count, Covariance* covs);
+
+inline void computeCovariancesScalar(const float* pos_array, const uint32_t* indices, const uint32_t* offsets,
+                                     size_t count, Covariance* covs)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        computeCovariance(pos_array, indices + offsets[i], offsets[i + 1] - offsets[i], covs[i]);
+    }
+}
+
+#ifdef UTILS_DISTANCE_KERNELS_X86
+
+/*! \brief Gathers the coordinates of the \p j-th neighbor of 8 neighborhoods.
+ *
+ * \return The mask of the lanes which have a \p j-th neighbor. The
+ *    coordinates of the other lanes are zero.
+ */
+__attribute__((target("avx2")))
+inline __m256 gatherNeighbor(const float* pos_array, const uint32_t* indices, __m256i begins, __m256i sizes,
+                             uint32_t j, __m256& x, __m256& y, __m256& z)
+{
+    const __m256i js = _mm256_set1_epi32(int(j));
+    const __m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(sizes, js));
+    const __m256i slots = _mm256_add_epi32(begins, js);
+    const __m256i idx = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(indices),
+                                                    slots, _mm256_castps_si256(active), 4);
+    const __m256i base = _mm256_add_epi32(idx, _mm256_add_epi32(idx, idx));
+    x = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), pos_array, base, active, 4);
+    y = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), pos_array + 1, base, active, 4);
+    z = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), pos_array + 2, base, active, 4);
+    return active;
+}
+
+/*! \brief Covariances of 8 neighborhoods at once, one per lane.
+ *
+ * Lanes whose neighborhood is exhausted are masked, adding exact zeros, so
+ * every lane sums in the same order as computeCovariance.
+ */
+__attribute__((target("avx2")))
+inline void computeCovariancesAVX2(const float* pos_array, const uint32_t* indices, const uint32_t* offsets,
+                                   size_t count, Covariance* covs)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i begins = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        const __m256i ends = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i + 1));
+        const __m256i sizes = _mm256_sub_epi32(ends, begins);
+        uint32_t max_size = 0;
+        for (int lane = 0; lane < 8; lane++)
+        {
+            max_size = std::max(max_size, offsets[i + lane + 1] - offsets[i + lane]);
+        }
+
+        __m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps(), sz = _mm256_setzero_ps();
+        for (uint32_t j = 0; j < max_size; j++)
+        {
+            __m256 x, y, z;
+            gatherNeighbor(pos_array, indices, begins, sizes, j, x, y, z);
+            sx = _mm256_add_ps(sx, x);
+            sy = _mm256_add_ps(sy, y);
+            sz = _mm256_add_ps(sz, z);
+        }
+        const __m256 count_f = _mm256_cvtepi32_ps(_mm256_max_epi32(sizes, _mm256_set1_epi32(1)));
+        const __m256 mx = _mm256_div_ps(sx, count_f);
+        const __m256 my = _mm256_div_ps(sy, count_f);
+        const __m256 mz = _mm256_div_ps(sz, count_f);
+
+        __m256 xx = _mm256_setzero_ps(), xy = _mm256_setzero_ps(), xz = _mm256_setzero_ps();
+        __m256 yy = _mm256_setzero_ps(), yz = _mm256_setzero_ps(), zz = _mm256_setzero_ps();
+        for (uint32_t j = 0; j < max_size; j++)
+        {
+            __m256 x, y, z;
+            const __m256 active = gatherNeighbor(pos_array, indices, begins, sizes, j, x, y, z);
+            const __m256 dx = _mm256_and_ps(active, _mm256_sub_ps(x, mx));
+            const __m256 dy = _mm256_and_ps(active, _mm256_sub_ps(y, my));
+            const __m256 dz = _mm256_and_ps(active, _mm256_sub_ps(z, mz));
+            xx = _mm256_add_ps(xx, _mm256_mul_ps(dx, dx));
+            xy = _mm256_add_ps(xy, _mm256_mul_ps(dx, dy));
+            xz = _mm256_add_ps(xz, _mm256_mul_ps(dx, dz));
+            yy = _mm256_add_ps(yy, _mm256_mul_ps(dy, dy));
+            yz = _mm256_add_ps(yz, _mm256_mul_ps(dy, dz));
+            zz = _mm256_add_ps(zz, _mm256_mul_ps(dz, dz));
+        }
+        const __m256 norm = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_max_epi32(sizes, _mm256_set1_epi32(2)), _mm256_set1_epi32(1)));
+
+        float out[9][8];
+        _mm256_storeu_ps(out[0], mx);
+        _mm256_storeu_ps(out[1], my);
+        _mm256_storeu_ps(out[2], mz);
+        _mm256_storeu_ps(out[3], _mm256_div_ps(xx, norm));
+        _mm256_storeu_ps(out[4], _mm256_div_ps(xy, norm));
+        _mm256_storeu_ps(out[5], _mm256_div_ps(xz, norm));
+        _mm256_storeu_ps(out[6], _mm256_div_ps(yy, norm));
+        _mm256_storeu_ps(out[7], _mm256_div_ps(yz, norm));
+        _mm256_storeu_ps(out[8], _mm256_div_ps(zz, norm));
+        for (int lane = 0; lane < 8; lane++)
+        {
+            Covariance& cov = covs[i + lane];
+            cov.mean[0] = out[0][lane];
+            cov.mean[1] = out[1][lane];
+            cov.mean[2] = out[2][lane];
+            cov.xx = out[3][lane];
+            cov.xy = out[4][lane];
+            cov.xz = out[5][lane];
+            cov.yy = out[6][lane];
+            cov.yz = out[7][lane];
+            cov.zz = out[8][lane];
+        }
+    }
+    computeCovariancesScalar(pos_array, indices, offsets + i, count - i, covs + i);
+}
+
+#endif // UTILS_DISTANCE_KERNELS_X86
+
+/*! \brief Computes the covariances of \p count neighborhoods.
+ *
+ * \param[in] pos_array The point coordinates, three floats per point.
+ * \param[in] indices The neighbor indices of all neighborhoods, back to back.
+ * \param[in] offsets The neighborhood i is indices[offsets[i]] up to indices[offsets[i+1]], \p count + 1 entries.
+ * \param[in] count The number of neighborhoods.
+ * \param[out] covs The covariances, \p count entries.
+ */
+inline void computeCovariances(const float* pos_array, const uint32_t* indices, const uint32_t* offsets,
+                               size_t count, Covariance* covs)
+{
+#ifdef UTILS_DISTANCE_KERNELS_X86
+    static const ComputeCovariancesFunc func = DistanceKernels::hasAVX2() ? computeCovariancesAVX2 : computeCovariancesScalar;
+#else
+    static const ComputeCovariancesFunc func = computeCovariancesScalar;
+#endif
+    func(pos_array, indices, offsets, count, covs);
+}
+
+/*! \brief Eigen decomposition of a covariance, in closed form.
+ *
+ * The eigenvalues follow from the trigonometric solution of the
+ * characteristic cubic.  The eigenvector of the smallest eigenvalue is the
+ * longest cross product of two rows of (C - lambda I).  When the smallest
+ * eigenvalue is a double root that vector is not unique and any unit
+ * vector perpendicular to the remaining direction is returned.
+ * The computation is done in double precision on the covariance scaled to
+ * unit size.
+ *
+ * \param[in] cov The covariance.
+ * \param[out] eigenvalues The eigenvalues, smallest first.
+ * \param[out] normal The unit eigenvector of the smallest eigenvalue.
+ */
+inline void solveEigen(const Covariance& cov, float eigenvalues[3], float normal[3])
+{
+    double scale = std::max(std::max(std::max(std::fabs(cov.xx), std::fabs(cov.xy)), std::max(std::fabs(cov.xz), std::fabs(cov.yy))),
+                            std::max(std::fabs(cov.yz), std::fabs(cov.zz)));
+    if (!(scale > 0) || !std::isfinite(scale))
+    {
+        eigenvalues[0] = eigenvalues[1] = eigenvalues[2] = 0;
+        normal[0] = 0; normal[1] = 1; normal[2] = 0;
+        return;
+    }
+    const double a00 = cov.xx / scale, a01 = cov.xy / scale, a02 = cov.xz / scale;
+    const double a11 = cov.yy / scale, a12 = cov.yz / scale, a22 = cov.zz / scale;
+
+    double lambda[3]; // ascending
+    const double p1 = a01 * a01 + a02 * a02 + a12 * a12;
+    const double q = (a00 + a11 + a22) / 3;
+    const double d0 = a00 - q, d1 = a11 - q, d2 = a22 - q;
+    const double p2 = d0 * d0 + d1 * d1 + d2 * d2 + 2 * p1;
+    if (p2 <= 1e-30)
+    {
+        lambda[0] = lambda[1] = lambda[2] = q;
+    }
+    else
+    {
+        const double p = std::sqrt(p2 / 6);
+        // r = det((C - qI) / p) / 2
+        const double det = d0 * (d1 * d2 - a12 * a12) - a01 * (a01 * d2 - a12 * a02) + a02 * (a01 * a12 - d1 * a02);
+        const double r = std::max(-1.0, std::min(1.0, det / (2 * p * p * p)));
+        const double phi = std::acos(r) / 3;
+        const double two_pi_3 = 2.0943951023931954923;
+        lambda[2] = q + 2 * p * std::cos(phi);
+        lambda[0] = q + 2 * p * std::cos(phi + two_pi_3);
+        lambda[1] = 3 * q - lambda[0] - lambda[2];
+    }
+    for (int idx = 0; idx < 3; idx++)
+    {
+        eigenvalues[idx] = float(std::max(0.0, lambda[idx]) * scale); // a covariance has no negative eigenvalues
+    }
+
+    const double rows[3][3] = {
+        { a00 - lambda[0], a01, a02 },
+        { a01, a11 - lambda[0], a12 },
+        { a02, a12, a22 - lambda[0] }
+    };
+    double best[3] = { 0, 0, 0 };
+    double best_len2 = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        const double* u = rows[i];
+        const double* v = rows[(i + 1) % 3];
+        double c[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        double len2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+        if (len2 > best_len2)
+        {
+            best_len2 = len2;
+            best[0] = c[0]; best[1] = c[1]; best[2] = c[2];
+        }
+    }
+    if (best_len2 <= 1e-24)
+    {
+        // (C - lambda I) has rank 1 or less: take a vector perpendicular to its longest row
+        int row_idx = 0;
+        double row_len2 = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            double len2 = rows[i][0] * rows[i][0] + rows[i][1] * rows[i][1] + rows[i][2] * rows[i][2];
+            if (len2 > row_len2)
+            {
+                row_len2 = len2;
+                row_idx = i;
+            }
+        }
+        if (row_len2 <= 1e-24)
+        {
+            normal[0] = 0; normal[1] = 1; normal[2] = 0;
+            return;
+        }
+        const double* u = rows[row_idx];
+        if (std::fabs(u[0]) > std::fabs(u[1]))
+        {
+            best[0] = -u[2]; best[1] = 0; best[2] = u[0];
+        }
+        else
+        {
+            best[0] = 0; best[1] = u[2]; best[2] = -u[1];
+        }
+        best_len2 = best[0] * best[0] + best[1] * best[1] + best[2] * best[2];
+    }
+    const double inv_len = 1 / std::sqrt(best_len2);
+    normal[0] = float(best[0] * inv_len);
+    normal[1] = float(best[1] * inv_len);
+    normal[2] = float(best[2] * inv_len);
+}
+
+/*! \brief Signature of solveEigens. */
+typedef void (*SolveEigensFunc)(const Covariance* covs, size_t count, float* eigenvalues, float* normals);
+
+inline void solveEigensScalar(const Covariance* covs, size_t count, float* eigenvalues, float* normals)
+{
+    float ignored[3];
+    for (size_t i = 0; i < count; i++)
+    {
+        solveEigen(covs[i], eigenvalues ? eigenvalues + i * 3 : ignored, normals + i * 3);
+    }
+}
+
+#ifdef UTILS_DISTANCE_KERNELS_X86
+
+/*! \brief Evaluates the polynomial with \p coeffs (lowest order first) at \p x, lane by lane. */
+template<size_t N>
+__attribute__((target("avx2")))
+inline __m256d polynomial4(const double (&coeffs)[N], __m256d x)
+{
+    __m256d result = _mm256_set1_pd(coeffs[N - 1]);
+    for (size_t k = N - 1; k > 0; k--)
+    {
+        result = _mm256_add_pd(_mm256_mul_pd(result, x), _mm256_set1_pd(coeffs[k - 1]));
+    }
+    return result;
+}
+
+/*! \brief acos of 4 values in [-1, 1], to about the precision of std::acos.
+ *
+ * asin(s) = s + s^3 * P(s^2) by its Taylor series, which converges quickly for
+ * s up to 1/2: acos(x) = pi/2 - asin(x) up to there, and 2 asin(sqrt((1 - x) / 2))
+ * beyond.
+ */
+__attribute__((target("avx2")))
+inline __m256d acos4(__m256d r)
+{
+    static const double asin_coeffs[] = {
+        0.16666666666666666, 0.074999999999999997, 0.044642857142857144, 0.030381944444444444,
+        0.022372159090909092, 0.017352764423076924, 0.013964843750000001, 0.011551800896139705,
+        0.0097616095291940784, 0.0083903358096168151, 0.0073125258735988454, 0.0064472103118896487,
+        0.0057400376708419236, 0.0051533096823199046, 0.0046601434869150962, 0.0042409070936793632,
+        0.0038809645588376691, 0.0035692053938259347, 0.0032970595034734849, 0.0030578216492580306,
+        0.0028461784011089421, 0.0026578706382072901, 0.0024894486782468836, 0.002338091892111975
+    };
+    const double pi = 3.14159265358979323846;
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d x = _mm256_andnot_pd(_mm256_set1_pd(-0.0), r);
+    const __m256d big = _mm256_cmp_pd(x, half, _CMP_GT_OQ);
+    const __m256d z = _mm256_blendv_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), x), half), big);
+    const __m256d s = _mm256_blendv_pd(x, _mm256_sqrt_pd(z), big);
+    const __m256d asin_s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_mul_pd(s, z), polynomial4(asin_coeffs, z)));
+    const __m256d acos_x = _mm256_blendv_pd(_mm256_sub_pd(_mm256_set1_pd(pi / 2), asin_s), _mm256_add_pd(asin_s, asin_s), big);
+    const __m256d negative = _mm256_cmp_pd(r, _mm256_setzero_pd(), _CMP_LT_OQ);
+    return _mm256_blendv_pd(acos_x, _mm256_sub_pd(_mm256_set1_pd(pi), acos_x), negative);
+}
+
+/*! \brief solveEigen of 4 covariances at once, one per lane, in double precision.
+ *
+ * The same operations as solveEigen, except that cos and acos are Taylor
+ * polynomials, so the results agree up to rounding.  Lanes which solveEigen
+ * handles as degenerate (zero covariance, triple eigenvalue or a double
+ * smallest eigenvalue) are computed by solveEigen itself.
+ */
+__attribute__((target("avx2")))
+inline void solveEigensAVX2(const Covariance* covs, size_t count, float* eigenvalues, float* normals)
+{
+    static const double cos_coeffs[] = {
+        1, -0.5, 0.041666666666666664, -0.0013888888888888889, 2.4801587301587302e-05, -2.7557319223985888e-07,
+        2.08767569878681e-09, -1.1470745597729725e-11, 4.7794773323873853e-14, -1.5619206968586225e-16, 4.1103176233121648e-19
+    };
+    static const double sin_coeffs[] = {
+        1, -0.16666666666666666, 0.0083333333333333332, -0.00019841269841269841, 2.7557319223985893e-06,
+        -2.505210838544172e-08, 1.6059043836821613e-10, -7.6471637318198164e-13, 2.8114572543455206e-15,
+        -8.2206352466243295e-18, 1.9572941063391263e-20
+    };
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0), three = _mm256_set1_pd(3.0), six = _mm256_set1_pd(6.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        double elements[6][4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            const Covariance& cov = covs[i + lane];
+            elements[0][lane] = cov.xx; elements[1][lane] = cov.xy; elements[2][lane] = cov.xz;
+            elements[3][lane] = cov.yy; elements[4][lane] = cov.yz; elements[5][lane] = cov.zz;
+        }
+        __m256d element[6];
+        __m256d scale = zero, has_nan = zero;
+        for (int k = 0; k < 6; k++)
+        {
+            element[k] = _mm256_loadu_pd(elements[k]);
+            scale = _mm256_max_pd(scale, _mm256_andnot_pd(_mm256_set1_pd(-0.0), element[k]));
+            has_nan = _mm256_or_pd(has_nan, _mm256_cmp_pd(element[k], element[k], _CMP_UNORD_Q));
+        }
+        __m256d degenerate = _mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(scale, zero, _CMP_LE_OQ), has_nan),
+                                          _mm256_cmp_pd(scale, _mm256_set1_pd(HUGE_VAL), _CMP_EQ_OQ));
+        const __m256d safe_scale = _mm256_blendv_pd(scale, one, degenerate);
+        const __m256d a00 = _mm256_div_pd(element[0], safe_scale), a01 = _mm256_div_pd(element[1], safe_scale);
+        const __m256d a02 = _mm256_div_pd(element[2], safe_scale), a11 = _mm256_div_pd(element[3], safe_scale);
+        const __m256d a12 = _mm256_div_pd(element[4], safe_scale), a22 = _mm256_div_pd(element[5], safe_scale);
+
+        const __m256d p1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a01, a01), _mm256_mul_pd(a02, a02)), _mm256_mul_pd(a12, a12));
+        const __m256d q = _mm256_div_pd(_mm256_add_pd(_mm256_add_pd(a00, a11), a22), three);
+        const __m256d d0 = _mm256_sub_pd(a00, q), d1 = _mm256_sub_pd(a11, q), d2 = _mm256_sub_pd(a22, q);
+        const __m256d p2 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(d0, d0), _mm256_mul_pd(d1, d1)), _mm256_mul_pd(d2, d2)),
+                                         _mm256_mul_pd(two, p1));
+        degenerate = _mm256_or_pd(degenerate, _mm256_cmp_pd(p2, _mm256_set1_pd(1e-30), _CMP_LE_OQ));
+        const __m256d p = _mm256_sqrt_pd(_mm256_div_pd(p2, six));
+        const __m256d det = _mm256_add_pd(_mm256_sub_pd(
+            _mm256_mul_pd(d0, _mm256_sub_pd(_mm256_mul_pd(d1, d2), _mm256_mul_pd(a12, a12))),
+            _mm256_mul_pd(a01, _mm256_sub_pd(_mm256_mul_pd(a01, d2), _mm256_mul_pd(a12, a02)))),
+            _mm256_mul_pd(a02, _mm256_sub_pd(_mm256_mul_pd(a01, a12), _mm256_mul_pd(d1, a02))));
+        const __m256d r = _mm256_max_pd(_mm256_set1_pd(-1.0), _mm256_min_pd(one,
+            _mm256_div_pd(det, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(two, p), p), p))));
+        const __m256d phi = _mm256_div_pd(acos4(r), three);
+        const __m256d phi2 = _mm256_mul_pd(phi, phi);
+        const __m256d cos_phi = polynomial4(cos_coeffs, phi2);
+        const __m256d sin_phi = _mm256_mul_pd(phi, polynomial4(sin_coeffs, phi2));
+        // cos(phi + 2 pi / 3) = -cos(phi) / 2 - sin(phi) * sqrt(3) / 2
+        const __m256d two_p = _mm256_mul_pd(two, p);
+        const __m256d lambda2 = _mm256_add_pd(q, _mm256_mul_pd(two_p, cos_phi));
+        const __m256d lambda0 = _mm256_add_pd(q, _mm256_mul_pd(two_p, _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(-0.5), cos_phi),
+                                                                                   _mm256_mul_pd(_mm256_set1_pd(0.86602540378443864676), sin_phi))));
+        const __m256d lambda1 = _mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(three, q), lambda0), lambda2);
+
+        const __m256d rows[3][3] = {
+            { _mm256_sub_pd(a00, lambda0), a01, a02 },
+            { a01, _mm256_sub_pd(a11, lambda0), a12 },
+            { a02, a12, _mm256_sub_pd(a22, lambda0) }
+        };
+        __m256d best[3] = { zero, zero, zero };
+        __m256d best_len2 = zero;
+        for (int k = 0; k < 3; k++)
+        {
+            const __m256d* u = rows[k];
+            const __m256d* v = rows[(k + 1) % 3];
+            const __m256d c[3] = {
+                _mm256_sub_pd(_mm256_mul_pd(u[1], v[2]), _mm256_mul_pd(u[2], v[1])),
+                _mm256_sub_pd(_mm256_mul_pd(u[2], v[0]), _mm256_mul_pd(u[0], v[2])),
+                _mm256_sub_pd(_mm256_mul_pd(u[0], v[1]), _mm256_mul_pd(u[1], v[0]))
+            };
+            const __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c[0], c[0]), _mm256_mul_pd(c[1], c[1])), _mm256_mul_pd(c[2], c[2]));
+            const __m256d longer = _mm256_cmp_pd(len2, best_len2, _CMP_GT_OQ);
+            best_len2 = _mm256_blendv_pd(best_len2, len2, longer);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                best[axis] = _mm256_blendv_pd(best[axis], c[axis], longer);
+            }
+        }
+        degenerate = _mm256_or_pd(degenerate, _mm256_cmp_pd(best_len2, _mm256_set1_pd(1e-24), _CMP_LE_OQ));
+        const __m256d inv_len = _mm256_div_pd(one, _mm256_sqrt_pd(best_len2));
+
+        float out[6][4];
+        const __m256d lambdas[3] = { lambda0, lambda1, lambda2 };
+        for (int k = 0; k < 3; k++)
+        {
+            _mm_storeu_ps(out[k], _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_max_pd(zero, lambdas[k]), scale)));
+            _mm_storeu_ps(out[3 + k], _mm256_cvtpd_ps(_mm256_mul_pd(best[k], inv_len)));
+        }
+        const int degenerate_lanes = _mm256_movemask_pd(degenerate);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            float* normal = normals + (i + lane) * 3;
+            float ignored[3];
+            float* values = eigenvalues ? eigenvalues + (i + lane) * 3 : ignored;
+            if (degenerate_lanes & (1 << lane))
+            {
+                solveEigen(covs[i + lane], values, normal);
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                values[k] = out[k][lane];
+                normal[k] = out[3 + k][lane];
+            }
+        }
+    }
+    solveEigensScalar(covs + i, count - i, eigenvalues ? eigenvalues + i * 3 : nullptr, normals + i * 3);
+}
+
+#endif // UTILS_DISTANCE_KERNELS_X86
+
+/*! \brief solveEigen of \p count covariances.
+ *
+ * \param[in] covs The covariances.
+ * \param[in] count The number of covariances.
+ * \param[out] eigenvalues The eigenvalues, three per covariance, smallest first. May be null.
+ * \param[out] normals The unit eigenvectors of the smallest eigenvalues, three floats per covariance.
+ */
+inline void solveEigens(const Covariance* covs, size_t count, float* eigenvalues, float* normals)
+{
+#ifdef UTILS_DISTANCE_KERNELS_X86
+    static const SolveEigensFunc func = DistanceKernels::hasAVX2() ? solveEigensAVX2 : solveEigensScalar;
+#else
+    static const SolveEigensFunc func = solveEigensScalar;
+#endif
+    func(covs, count, eigenvalues, normals);
+}
+
+} // namespace NormalKernels
+
+} // namespace cura
+
+#endif // UTILS_NORMAL_KERNELS_H
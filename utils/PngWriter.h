@@ -0,0 +1,176 @@
+#ifndef UTILS_PNG_WRITER_H
+#define UTILS_PNG_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef PNTWORKS_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace cura {
+
+/*! \brief Encodes 8-bit RGB or RGBA images as PNG files.
+ *
+ * The image data is compressed with zlib when it is available
+ * (PNTWORKS_WITH_ZLIB); otherwise it is written as stored deflate blocks,
+ * which makes larger files but takes no time to compress.  Safe to use from
+ * several threads at once.
+ */
+class PngWriter
+{
+public:
+    /*! \brief Encodes an image into \p out.
+     *
+     * \param[in] pixels The rows of \p width pixels of \p channels bytes (3 or 4), without padding.
+     * \param[in] bottom_up Whether the first row is the bottom of the image, as read by glReadPixels.
+     */
+    static void encode(std::vector<unsigned char>& out, int width, int height, int channels,
+        const unsigned char* pixels, bool bottom_up = false)
+    {
+        out.clear();
+        static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+        out.insert(out.end(), signature, signature + 8);
+
+        unsigned char header[13];
+        putBigEndian(header, (uint32_t)width);
+        putBigEndian(header + 4, (uint32_t)height);
+        header[8] = 8;                                  // bit depth
+        header[9] = (channels == 4) ? 6 : 2;            // RGBA or RGB
+        header[10] = header[11] = header[12] = 0;       // deflate, adaptive filtering, no interlace
+        appendChunk(out, "IHDR", header, sizeof(header));
+
+        // Every row is preceded by its filter type. The Sub filter turns the flat
+        // backgrounds of rendered images into runs of zeros, which compress well;
+        // stored blocks are not compressed, so their rows are left unfiltered.
+        size_t row_size = (size_t)width * channels;
+        std::vector<unsigned char> raw((row_size + 1) * height);
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char* src = pixels + row_size * (bottom_up ? height - 1 - y : y);
+            unsigned char* dst = &raw[(row_size + 1) * y];
+#ifdef PNTWORKS_WITH_ZLIB
+            dst[0] = 1;
+            memcpy(dst + 1, src, channels);
+            for (size_t i = channels; i < row_size; i++) dst[1 + i] = (unsigned char)(src[i] - src[i - channels]);
+#else
+            dst[0] = 0;
+            memcpy(dst + 1, src, row_size);
+#endif
+        }
+
+        std::vector<unsigned char> data;
+        deflate(data, raw);
+        appendChunk(out, "IDAT", data.empty() ? NULL : &data[0], data.size());
+        appendChunk(out, "IEND", NULL, 0);
+    }
+
+    /*! \brief Encodes an image and writes it to \p filename.
+     *
+     * \return Whether the file could be written.
+     */
+    static bool write(const char* filename, int width, int height, int channels,
+        const unsigned char* pixels, bool bottom_up = false)
+    {
+        std::vector<unsigned char> png;
+        encode(png, width, height, channels, pixels, bottom_up);
+        FILE* fp = fopen(filename, "wb");
+        if (!fp) return false;
+        bool written = (fwrite(&png[0], 1, png.size(), fp) == png.size());
+        return (fclose(fp) == 0) && written;
+    }
+
+private:
+    struct CrcTable
+    {
+        uint32_t values[256];
+        CrcTable()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                values[n] = c;
+            }
+        }
+    };
+
+    static void putBigEndian(unsigned char* dst, uint32_t value)
+    {
+        dst[0] = (unsigned char)(value >> 24);
+        dst[1] = (unsigned char)(value >> 16);
+        dst[2] = (unsigned char)(value >> 8);
+        dst[3] = (unsigned char)value;
+    }
+
+    static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size)
+    {
+        static const CrcTable table;
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void appendChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+    {
+        unsigned char word[4];
+        putBigEndian(word, (uint32_t)size);
+        out.insert(out.end(), word, word + 4);
+        size_t type_begin = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0) out.insert(out.end(), data, data + size);
+        putBigEndian(word, crc32(0, &out[type_begin], size + 4));
+        out.insert(out.end(), word, word + 4);
+    }
+
+    /*! \brief The zlib stream of \p raw. */
+    static void deflate(std::vector<unsigned char>& out, const std::vector<unsigned char>& raw)
+    {
+#ifdef PNTWORKS_WITH_ZLIB
+        uLongf size = compressBound((uLong)raw.size());
+        out.resize(size);
+        if (compress2(&out[0], &size, &raw[0], (uLong)raw.size(), Z_BEST_SPEED) == Z_OK)
+        {
+            out.resize(size);
+            return;
+        }
+#endif
+        // Stored blocks of at most 65535 bytes, then the Adler-32 checksum
+        out.clear();
+        out.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        out.push_back(0x78);
+        out.push_back(0x01);
+        size_t pos = 0;
+        do
+        {
+            size_t block = raw.size() - pos;
+            if (block > 65535) block = 65535;
+            out.push_back((pos + block == raw.size()) ? 1 : 0);
+            out.push_back((unsigned char)block);
+            out.push_back((unsigned char)(block >> 8));
+            out.push_back((unsigned char)~block);
+            out.push_back((unsigned char)(~block >> 8));
+            out.insert(out.end(), raw.begin() + pos, raw.begin() + pos + block);
+            pos += block;
+        } while (pos < raw.size());
+
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); )
+        {
+            // 5552 bytes is the most before the sums could overflow
+            size_t end = (raw.size() - i > 5552) ? i + 5552 : raw.size();
+            for (; i < end; i++) {a += raw[i]; b += a;}
+            a %= 65521;
+            b %= 65521;
+        }
+        unsigned char word[4];
+        putBigEndian(word, (b << 16) | a);
+        out.insert(out.end(), word, word + 4);
+    }
+};
+
+} // namespace cura
+
+#endif // UTILS_PNG_WRITER_H
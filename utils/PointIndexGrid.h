@@ -0,0 +1,1195 @@
+#ifndef UTILS_POINT_INDEX_GRID_H
+#define UTILS_POINT_INDEX_GRID_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "intpoint.h"
+#include "floatpoint.h"
+#include "SparseGrid.h"
+#include "DistanceKernels.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace cura {
+
+/*! \brief Sparse grid over a flat xyz coordinate array which stores point indices.
+ *
+ * Unlike SparsePointGrid, which allocates a hash node for every inserted
+ * element, this grid is built in bulk: the cell key of every point is
+ * computed in parallel, the points are counting-sorted by cell key (LSD
+ * radix sort), and each non-empty cell becomes one contiguous range of
+ * point indices.  The coordinates are copied into the same cell order so
+ * that queries scan memory linearly.
+ *
+ * Points are assigned to cells with the same truncating mapping as
+ * SparseGrid::toGridPoint, and points within a cell keep their input order,
+ * so queries see the same cell contents as a SparsePointGrid filled by
+ * calling insert for every point in order.
+ *
+ * All data lives in a few flat arrays, so a built grid can be saved next to
+ * the point file and later mapped back without rebuilding (see save and
+ * load).  The file is tied to the point data by a content hash.
+ */
+class PointIndexGrid
+{
+public:
+    using GridPoint = Point3;
+    using grid_coord_t = int32_t;
+    using cell_key_t = uint64_t;
+
+    enum : uint32_t { NO_CELL = 0xFFFFFFFFu };
+
+    /*! \brief Constructs an empty grid with the specified cell size.
+     *
+     * \param[in] cell_size The size to use for a cell (cube) in the grid.
+     *    Typical values would be around 0.5-2x of expected query radius.
+     */
+    PointIndexGrid(coord_t cell_size);
+
+    /*! \brief Fills the grid with all points of a flat xyz coordinate array.
+     *
+     * Any previous content is discarded.  The key computation, the sorting
+     * passes and the coordinate gathering run in parallel.
+     *
+     * \param[in] pos_array The coordinates, three floats per point.
+     * \param[in] pnts_num The number of points in \p pos_array.
+     */
+    void build(const float* pos_array, unsigned int pnts_num);
+
+    /*! \brief Process the indices of points in cells that might be within \p radius of \p query_pt.
+     *
+     * Processes all points that are within radius of query_pt.  May
+     * process points that are up to radius + cell_size from query_pt.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[in] process_func Processes each point index. Processing stops if function returns false.
+     */
+    template<typename Func>
+    void processNearby(const FPoint3& query_pt, coord_t radius, const Func& process_func) const;
+
+    /*! \brief Finds the \p k points nearest to \p query_pt.
+     *
+     * The search starts with the cells within \p radius and grows by one
+     * cell size at a time until the \p k nearest points are known.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] k The number of neighbors.
+     * \param[in] radius The initial search radius.
+     * \return The point indices, nearest first. Fewer than \p k when the
+     *    grid holds fewer points.
+     */
+    std::vector<unsigned int> getKnn(const FPoint3& query_pt, unsigned int k, coord_t radius) const;
+
+    /*! \brief A point found by a radius query. */
+    struct Neighbor
+    {
+        unsigned int idx;   //!< The index of the point.
+        float dist2;        //!< The squared distance to the query point.
+        bool operator<(const Neighbor& b) const { return dist2 < b.dist2; }
+    };
+
+    /*! \brief Finds the \p k points nearest to \p query_pt, without allocating.
+     *
+     * Same as getKnn above, but writes into \p result, whose capacity is
+     * reused, so a caller keeping one vector per thread does not allocate
+     * per query.
+     *
+     * \param[out] result The neighbors, nearest first.
+     */
+    void getKnn(const FPoint3& query_pt, unsigned int k, coord_t radius, std::vector<Neighbor>& result) const;
+
+    /*! \brief Neighbors of a batch of query points, stored back to back.
+     *
+     * The neighbors of query i are neighbors[offsets[i]] up to
+     * neighbors[offsets[i+1]].  The vectors keep their capacity, so reusing
+     * one batch for repeated queries does not allocate.
+     */
+    struct NeighborBatch
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<Neighbor> neighbors;
+    };
+
+    /*! \brief Finds all points within \p radius of \p query_pt.
+     *
+     * Unlike processNearby, only points that are actually within \p radius
+     * are returned.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[out] result The points found. Cleared first, its capacity is reused.
+     * \param[in] max_nn If non-zero, only the \p max_nn nearest points are
+     *    returned, nearest first. Otherwise the points are in grid order.
+     */
+    void getRadiusNeighbors(const FPoint3& query_pt, coord_t radius, std::vector<Neighbor>& result, unsigned int max_nn = 0) const;
+
+    /*! \brief Runs getRadiusNeighbors for many query points in parallel.
+     *
+     * \param[in] query_array The query coordinates, three floats per query.
+     * \param[in] query_num The number of queries.
+     * \param[in] radius The search radius.
+     * \param[in] max_nn If non-zero, at most this many neighbors per query.
+     * \param[out] batch The neighbors of all queries.
+     */
+    void getRadiusNeighborsBatch(const float* query_array, unsigned int query_num, coord_t radius,
+                                 unsigned int max_nn, NeighborBatch& batch) const;
+
+    /*! \brief Finds the first point along a ray, e.g. the point under the cursor.
+     *
+     * A point is hit when its distance to the ray is at most
+     * \p radius + t * \p radius_slope, where t is its distance along the ray,
+     * so a zero slope tests a cylinder and a positive slope a cone.  Only the
+     * cells around the ray are visited, front to back, and the walk stops as
+     * soon as no later cell can hold a nearer hit.
+     *
+     * \param[in] origin The start of the ray.
+     * \param[in] direction The direction of the ray, normalized.
+     * \param[in] radius The hit distance at the ray origin.
+     * \param[in] radius_slope The growth of the hit distance along the ray.
+     * \param[out] hit_idx The index of the hit point.
+     * \param[out] hit_t The distance along the ray of the hit point.
+     * \return Whether a point has been hit.
+     */
+    bool pickAlongRay(const FPoint3& origin, const FPoint3& direction, coord_t radius, float radius_slope,
+                      unsigned int& hit_idx, float& hit_t) const;
+
+    /*! \brief Writes the grid to a file which load can map back.
+     *
+     * All arrays are stored at file offsets, so the layout does not depend
+     * on where the file ends up in memory.
+     *
+     * \param[in] filename The file to write.
+     * \param[in] content_hash The hash of the point data, see hashPositions.
+     * \return Whether the file has been written.
+     */
+    bool save(const char* filename, uint64_t content_hash) const;
+
+    /*! \brief Maps a grid written by save, replacing the current content.
+     *
+     * The arrays are used in place from the mapping, nothing is rebuilt. They
+     * are checked for consistency first (one pass over each), so a truncated or
+     * damaged file is rejected rather than indexed out of bounds.
+     *
+     * \param[in] filename The file to map.
+     * \param[in] content_hash The hash of the current point data. The file is
+     *    rejected when it was saved for different data.
+     * \return Whether the grid has been loaded.
+     */
+    bool load(const char* filename, uint64_t content_hash);
+
+    /*! \brief Computes the content hash of a flat xyz coordinate array.
+     *
+     * The array is hashed (FNV-1a) in fixed-size blocks in parallel, and the
+     * block hashes are combined in order, so the result does not depend on
+     * the number of threads.
+     */
+    static uint64_t hashPositions(const float* pos_array, unsigned int pnts_num);
+
+    /*! \brief Moves points to new positions, or adds points, without rebuilding.
+     *
+     * A point that stays in its cell has its coordinates updated in place.
+     * A point that leaves its cell (or is new) has its old slot blanked out
+     * and is appended to an overflow list which every query scans, so the
+     * cost is proportional to the number of changed points.  Once the
+     * overflow would get too long, nothing is changed and false is returned:
+     * the grid should then be rebuilt.  A grid with overflow cannot be saved.
+     *
+     * \param[in] pos_array The coordinates of all points, after the change.
+     * \param[in] indices The changed points. Indices from getPointCount() on
+     *    add points, all added points have to be listed.
+     * \param[in] n The number of indices.
+     * \param[out] old_positions If not null, receives the coordinates stored
+     *    before the change, three floats per index (NaN for added points).
+     *    Also filled in when false is returned.
+     * \return Whether the grid has been updated.
+     */
+    bool updatePoints(const float* pos_array, const uint32_t* indices, size_t n, float* old_positions = nullptr);
+
+    coord_t getCellSize() const { return m_cell_size; }
+    unsigned int getPointCount() const { return m_point_count; }
+    unsigned int getCellCount() const { return m_cell_count; }
+
+protected:
+    /*! \brief Compute the grid coordinate of a coordinate, see SparseGrid::toGridCoord. */
+    grid_coord_t toGridCoord(const coord_t& coord) const
+    {
+        return static_cast<int_coord_t>(coord / m_cell_size);
+    }
+
+    /*! \brief Compute the key of a cell, which orders cells by z, then y, then x. */
+    cell_key_t toCellKey(grid_coord_t x, grid_coord_t y, grid_coord_t z) const
+    {
+        return (cell_key_t(z - m_min_grid.z) * m_dims[1] + cell_key_t(y - m_min_grid.y)) * m_dims[0]
+            + cell_key_t(x - m_min_grid.x);
+    }
+
+    /*! \brief Find the cell with grid coordinates (\p x, \p y, \p z).
+     *
+     * \return The index of the cell, or NO_CELL if it is empty.
+     */
+    uint32_t findCell(grid_coord_t x, grid_coord_t y, grid_coord_t z) const;
+
+    /*! \brief Same as findCell, for the key of a cell within the grid bounds. */
+    uint32_t findCellByKey(cell_key_t key) const;
+
+    /*! \brief Whether the cell ranges, point indices and hash table are consistent, see load. */
+    bool validateArrays() const;
+
+    /*! \brief Process the point ranges of all non-empty cells overlapping a box.
+     *
+     * \param[in] process_func Called as process_func(slot_begin, slot_end)
+     *    for each cell. Processing stops if function returns false.
+     * \return Whether all cells have been processed.
+     */
+    template<typename Func>
+    bool processCells(const FPoint3& min_loc, const FPoint3& max_loc, const Func& process_func) const;
+
+    /*! \brief Same as processCells, without the overflow slots of moved points. */
+    template<typename Func>
+    bool processGridCells(const FPoint3& min_loc, const FPoint3& max_loc, const Func& process_func) const;
+
+    /*! \brief Passes the slots of the cells along a ray to \p test_slots, front to back.
+     *
+     * The walk stops once \p found is set and no later cell can hold a hit
+     * nearer than \p best_t, both of which \p test_slots updates.
+     */
+    template<typename Func>
+    void walkRay(const FPoint3& origin, const FPoint3& direction, coord_t radius, float radius_slope,
+                 const bool& found, const float& best_t, const Func& test_slots) const;
+
+    /*! \brief Whether cell (\p x, \p y, \p z) may hold a point within the hit distance of a ray, see pickAlongRay. */
+    bool cellNearRay(grid_coord_t x, grid_coord_t y, grid_coord_t z, const FPoint3& origin, const FPoint3& direction,
+                     coord_t radius, float radius_slope) const;
+
+    /*! \brief The first slot of the overflow list, see updatePoints. */
+    uint32_t getOverflowBegin() const { return m_cell_begin[m_cell_count]; }
+
+    /*! \brief Process the slots in [\p slot_begin, \p slot_end) within \p max_dist2 of \p query_pt.
+     *
+     * The distances are computed by the SIMD kernels in blocks of slots.
+     * \p max_dist2 is read again before each block, so a top-k search can
+     * tighten it while processing.
+     *
+     * \param[in] process_func Called as process_func(slot, dist2).
+     */
+    template<typename Func>
+    void filterSlots(uint32_t slot_begin, uint32_t slot_end, const FPoint3& query_pt, const float& max_dist2,
+                     const Func& process_func) const
+    {
+        const uint32_t block_size = 256;
+        uint32_t offsets[block_size];
+        float dist2[block_size];
+        for (uint32_t block_begin = slot_begin; block_begin < slot_end; block_begin += block_size)
+        {
+            uint32_t block_count = std::min(slot_end - block_begin, block_size);
+            size_t found = DistanceKernels::filterWithin(m_xs + block_begin, m_ys + block_begin, m_zs + block_begin, block_count,
+                                                         query_pt.x, query_pt.y, query_pt.z, max_dist2, offsets, dist2);
+            for (size_t i = 0; i < found; i++)
+            {
+                process_func(block_begin + offsets[i], dist2[i]);
+            }
+        }
+    }
+
+    static uint64_t hashKey(cell_key_t key)
+    {
+        return key * 0x9E3779B97F4A7C15ull;
+    }
+
+    static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    /*! \brief Resets the grid to an empty one. */
+    void clear();
+
+    /*! \brief Points the arrays at the owned storage vectors, which hold the whole grid. */
+    void useOwnedStorage();
+
+    /*! \brief Points the arrays at the owned storage vectors, without touching the counts. */
+    void pointAtOwnedStorage();
+
+    /*! \brief Header of a saved grid, followed by the arrays at the given offsets. */
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t content_hash;
+        uint64_t file_size;
+        float cell_size;
+        int32_t min_grid[3];
+        int32_t max_grid[3];
+        uint32_t point_count;
+        uint32_t cell_count;
+        uint32_t table_bits;
+        uint64_t dims[3];
+        uint64_t cell_keys_offset;
+        uint64_t cell_begin_offset;
+        uint64_t point_indices_offset;
+        uint64_t xs_offset;
+        uint64_t ys_offset;
+        uint64_t zs_offset;
+        uint64_t table_offset;
+    };
+
+    coord_t m_cell_size;
+    GridPoint m_min_grid;
+    GridPoint m_max_grid;
+    cell_key_t m_dims[3];
+    uint32_t m_point_count;
+    uint32_t m_cell_count;
+    /*! \brief The number of slots, including the overflow slots after the last cell. */
+    uint32_t m_slot_count;
+
+    /*! \brief Sorted keys of the non-empty cells. */
+    const cell_key_t* m_cell_keys;
+    /*! \brief Slot range of each cell, cell i owns [m_cell_begin[i], m_cell_begin[i+1]). */
+    const uint32_t* m_cell_begin;
+    /*! \brief The point index stored in each slot. */
+    const uint32_t* m_point_indices;
+    /*! \brief The point coordinates stored in each slot. */
+    const float* m_xs;
+    const float* m_ys;
+    const float* m_zs;
+    /*! \brief Open addressing hash table from cell key to cell index. */
+    const uint32_t* m_table;
+    uint64_t m_table_mask;
+    unsigned int m_table_shift;
+
+    /*! \brief Storage of a grid built in memory. */
+    std::vector<cell_key_t> m_cell_keys_store;
+    std::vector<uint32_t> m_cell_begin_store;
+    std::vector<uint32_t> m_point_indices_store;
+    std::vector<float> m_xs_store, m_ys_store, m_zs_store;
+    std::vector<uint32_t> m_table_store;
+    /*! \brief Storage of a grid loaded from a file. */
+    std::unique_ptr<MappedFile> m_mapped_file;
+    /*! \brief The slot of each point, only set up by updatePoints. */
+    std::vector<uint32_t> m_slot_of_point;
+};
+
+
+inline PointIndexGrid::PointIndexGrid(coord_t cell_size)
+: m_cell_size(cell_size)
+{
+    assert(cell_size > 0);
+    clear();
+}
+
+inline void PointIndexGrid::clear()
+{
+    m_mapped_file.reset();
+    m_cell_keys_store.clear();
+    m_cell_begin_store.assign(1, 0);
+    m_point_indices_store.clear();
+    m_xs_store.clear();     m_ys_store.clear();     m_zs_store.clear();
+    m_table_store.assign(2, uint32_t(NO_CELL));
+    m_table_mask = 1;
+    m_table_shift = 63;
+    m_min_grid = GridPoint(0, 0, 0);
+    m_max_grid = GridPoint(-1, -1, -1);
+    m_dims[0] = m_dims[1] = m_dims[2] = 0;
+    m_slot_of_point.clear();
+    useOwnedStorage();
+}
+
+inline void PointIndexGrid::useOwnedStorage()
+{
+    m_point_count = (uint32_t)m_point_indices_store.size();
+    m_cell_count = (uint32_t)m_cell_keys_store.size();
+    m_slot_count = m_point_count;
+    pointAtOwnedStorage();
+}
+
+inline void PointIndexGrid::pointAtOwnedStorage()
+{
+    m_cell_keys = m_cell_keys_store.data();
+    m_cell_begin = m_cell_begin_store.data();
+    m_point_indices = m_point_indices_store.data();
+    m_xs = m_xs_store.data();   m_ys = m_ys_store.data();   m_zs = m_zs_store.data();
+    m_table = m_table_store.data();
+}
+
+inline void PointIndexGrid::build(const float* pos_array, unsigned int pnts_num)
+{
+    clear();
+    if (pnts_num == 0) return;
+
+    const unsigned int chunk_count = (pnts_num < 4096) ? 1 : getThreadCount();
+
+    //--------------------------------------------------------------------------------------
+    //	Grid bounds, computed per chunk and merged
+    std::vector<GridPoint> chunk_min(chunk_count), chunk_max(chunk_count);
+    parallelForChunks(pnts_num, chunk_count,
+        [&](unsigned int chunk_idx, size_t begin, size_t end)
+        {
+            GridPoint lo(std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+            GridPoint hi(std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min());
+            for (size_t i = begin; i < end; i++)
+            {
+                grid_coord_t x = toGridCoord(pos_array[i * 3]);
+                grid_coord_t y = toGridCoord(pos_array[i * 3 + 1]);
+                grid_coord_t z = toGridCoord(pos_array[i * 3 + 2]);
+                lo.x = std::min(lo.x, x);   lo.y = std::min(lo.y, y);   lo.z = std::min(lo.z, z);
+                hi.x = std::max(hi.x, x);   hi.y = std::max(hi.y, y);   hi.z = std::max(hi.z, z);
+            }
+            chunk_min[chunk_idx] = lo;
+            chunk_max[chunk_idx] = hi;
+        });
+    m_min_grid = chunk_min[0];  m_max_grid = chunk_max[0];
+    for (unsigned int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++)
+    {
+        const GridPoint& lo = chunk_min[chunk_idx];
+        const GridPoint& hi = chunk_max[chunk_idx];
+        m_min_grid.x = std::min(m_min_grid.x, lo.x);   m_min_grid.y = std::min(m_min_grid.y, lo.y);   m_min_grid.z = std::min(m_min_grid.z, lo.z);
+        m_max_grid.x = std::max(m_max_grid.x, hi.x);   m_max_grid.y = std::max(m_max_grid.y, hi.y);   m_max_grid.z = std::max(m_max_grid.z, hi.z);
+    }
+    m_dims[0] = cell_key_t(int64_t(m_max_grid.x) - m_min_grid.x + 1);
+    m_dims[1] = cell_key_t(int64_t(m_max_grid.y) - m_min_grid.y + 1);
+    m_dims[2] = cell_key_t(int64_t(m_max_grid.z) - m_min_grid.z + 1);
+    const cell_key_t max_key = m_dims[0] * m_dims[1] * m_dims[2] - 1;
+
+    //--------------------------------------------------------------------------------------
+    //	Cell key of every point
+    std::vector<cell_key_t> keys(pnts_num), keys_tmp(pnts_num);
+    std::vector<uint32_t> indices(pnts_num), indices_tmp(pnts_num);
+    parallelForChunks(pnts_num, chunk_count,
+        [&](unsigned int, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                keys[i] = toCellKey(toGridCoord(pos_array[i * 3]), toGridCoord(pos_array[i * 3 + 1]), toGridCoord(pos_array[i * 3 + 2]));
+                indices[i] = (uint32_t)i;
+            }
+        });
+
+    //--------------------------------------------------------------------------------------
+    //	Stable LSD radix sort by cell key: one counting sort per digit, each
+    //	chunk counts its own digits and scatters into its own output range.
+    const unsigned int digit_bits = 11;
+    const size_t bucket_count = size_t(1) << digit_bits;
+    unsigned int key_bits = 0;
+    while (key_bits < 64 && (max_key >> key_bits) != 0) key_bits++;
+    std::vector<uint32_t> histograms(chunk_count * bucket_count);
+    for (unsigned int shift = 0; shift < key_bits; shift += digit_bits)
+    {
+        std::fill(histograms.begin(), histograms.end(), 0);
+        parallelForChunks(pnts_num, chunk_count,
+            [&](unsigned int chunk_idx, size_t begin, size_t end)
+            {
+                uint32_t* histogram = &histograms[chunk_idx * bucket_count];
+                for (size_t i = begin; i < end; i++)
+                {
+                    histogram[(keys[i] >> shift) & (bucket_count - 1)]++;
+                }
+            });
+        uint32_t offset = 0;
+        for (size_t bucket = 0; bucket < bucket_count; bucket++)
+        {
+            for (unsigned int chunk_idx = 0; chunk_idx < chunk_count; chunk_idx++)
+            {
+                uint32_t count = histograms[chunk_idx * bucket_count + bucket];
+                histograms[chunk_idx * bucket_count + bucket] = offset;
+                offset += count;
+            }
+        }
+        parallelForChunks(pnts_num, chunk_count,
+            [&](unsigned int chunk_idx, size_t begin, size_t end)
+            {
+                uint32_t* offsets = &histograms[chunk_idx * bucket_count];
+                for (size_t i = begin; i < end; i++)
+                {
+                    uint32_t dst = offsets[(keys[i] >> shift) & (bucket_count - 1)]++;
+                    keys_tmp[dst] = keys[i];
+                    indices_tmp[dst] = indices[i];
+                }
+            });
+        keys.swap(keys_tmp);
+        indices.swap(indices_tmp);
+    }
+    std::vector<cell_key_t>().swap(keys_tmp);
+    std::vector<uint32_t>().swap(indices_tmp);
+
+    //--------------------------------------------------------------------------------------
+    //	Cell ranges and cell-ordered coordinates
+    m_cell_begin_store.clear();
+    for (unsigned int i = 0; i < pnts_num; i++)
+    {
+        if (i == 0 || keys[i] != keys[i - 1])
+        {
+            m_cell_begin_store.push_back(i);
+            m_cell_keys_store.push_back(keys[i]);
+        }
+    }
+    m_cell_begin_store.push_back(pnts_num);
+    m_point_indices_store.swap(indices);
+    m_xs_store.resize(pnts_num);    m_ys_store.resize(pnts_num);    m_zs_store.resize(pnts_num);
+    parallelForChunks(pnts_num, chunk_count,
+        [&](unsigned int, size_t begin, size_t end)
+        {
+            for (size_t slot = begin; slot < end; slot++)
+            {
+                const float* pos = &pos_array[size_t(m_point_indices_store[slot]) * 3];
+                m_xs_store[slot] = pos[0];  m_ys_store[slot] = pos[1];  m_zs_store[slot] = pos[2];
+            }
+        });
+
+    //--------------------------------------------------------------------------------------
+    //	Cell lookup table, at most half full
+    unsigned int table_bits = 1;
+    while ((size_t(1) << table_bits) < m_cell_keys_store.size() * 2) table_bits++;
+    m_table_store.assign(size_t(1) << table_bits, uint32_t(NO_CELL));
+    m_table_mask = (uint64_t(1) << table_bits) - 1;
+    m_table_shift = 64 - table_bits;
+    for (uint32_t cell_idx = 0; cell_idx < m_cell_keys_store.size(); cell_idx++)
+    {
+        uint64_t pos = hashKey(m_cell_keys_store[cell_idx]) >> m_table_shift;
+        while (m_table_store[pos] != NO_CELL) pos = (pos + 1) & m_table_mask;
+        m_table_store[pos] = cell_idx;
+    }
+    useOwnedStorage();
+}
+
+inline uint32_t PointIndexGrid::findCell(grid_coord_t x, grid_coord_t y, grid_coord_t z) const
+{
+    if (x < m_min_grid.x || x > m_max_grid.x || y < m_min_grid.y || y > m_max_grid.y
+        || z < m_min_grid.z || z > m_max_grid.z)
+    {
+        return NO_CELL;
+    }
+    return findCellByKey(toCellKey(x, y, z));
+}
+
+inline uint32_t PointIndexGrid::findCellByKey(cell_key_t key) const
+{
+    uint64_t pos = hashKey(key) >> m_table_shift;
+    while (true)
+    {
+        uint32_t cell_idx = m_table[pos];
+        if (cell_idx == NO_CELL || m_cell_keys[cell_idx] == key) return cell_idx;
+        pos = (pos + 1) & m_table_mask;
+    }
+}
+
+template<typename Func>
+bool PointIndexGrid::processGridCells(const FPoint3& min_loc, const FPoint3& max_loc, const Func& process_func) const
+{
+    if (m_cell_count == 0) return true;
+
+    grid_coord_t min_x = std::max(toGridCoord(min_loc.x), m_min_grid.x);
+    grid_coord_t min_y = std::max(toGridCoord(min_loc.y), m_min_grid.y);
+    grid_coord_t min_z = std::max(toGridCoord(min_loc.z), m_min_grid.z);
+    grid_coord_t max_x = std::min(toGridCoord(max_loc.x), m_max_grid.x);
+    grid_coord_t max_y = std::min(toGridCoord(max_loc.y), m_max_grid.y);
+    grid_coord_t max_z = std::min(toGridCoord(max_loc.z), m_max_grid.z);
+
+    for (grid_coord_t grid_z = min_z; grid_z <= max_z; ++grid_z)
+    {
+        for (grid_coord_t grid_y = min_y; grid_y <= max_y; ++grid_y)
+        {
+            for (grid_coord_t grid_x = min_x; grid_x <= max_x; ++grid_x)
+            {
+                uint32_t cell_idx = findCell(grid_x, grid_y, grid_z);
+                if (cell_idx == NO_CELL) continue;
+                if (!process_func(m_cell_begin[cell_idx], m_cell_begin[cell_idx + 1]))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template<typename Func>
+bool PointIndexGrid::processCells(const FPoint3& min_loc, const FPoint3& max_loc, const Func& process_func) const
+{
+    if (!processGridCells(min_loc, max_loc, process_func)) return false;
+    // Points moved out of their cells may be anywhere
+    if (m_slot_count > getOverflowBegin())
+    {
+        return process_func(getOverflowBegin(), m_slot_count);
+    }
+    return true;
+}
+
+template<typename Func>
+void PointIndexGrid::processNearby(const FPoint3& query_pt, coord_t radius, const Func& process_func) const
+{
+    FPoint3 min_loc = query_pt - FPoint3(radius, radius, radius);
+    FPoint3 max_loc = query_pt + FPoint3(radius, radius, radius);
+    processCells(min_loc, max_loc,
+        [this, &process_func](uint32_t slot_begin, uint32_t slot_end)
+        {
+            for (uint32_t slot = slot_begin; slot < slot_end; slot++)
+            {
+                if (std::isnan(m_xs[slot])) continue; // blanked by updatePoints
+                if (!process_func(m_point_indices[slot])) return false;
+            }
+            return true;
+        });
+}
+
+inline std::vector<unsigned int> PointIndexGrid::getKnn(const FPoint3& query_pt, unsigned int k, coord_t radius) const
+{
+    std::vector<Neighbor> queue;
+    getKnn(query_pt, k, radius, queue);
+    std::vector<unsigned int> ret(queue.size());
+    for (size_t idx = 0; idx < queue.size(); idx++)
+    {
+        ret[idx] = queue[idx].idx;
+    }
+    return ret;
+}
+
+inline void PointIndexGrid::getKnn(const FPoint3& query_pt, unsigned int k, coord_t radius, std::vector<Neighbor>& queue) const
+{
+    queue.clear();
+    queue.reserve(k + 1);
+    k = std::min(k, getPointCount());
+
+    // Radius at which the search box covers the whole grid
+    coord_t max_radius = 0;
+    const float query_coords[3] = { query_pt.x, query_pt.y, query_pt.z };
+    const grid_coord_t min_grid[3] = { m_min_grid.x, m_min_grid.y, m_min_grid.z };
+    const grid_coord_t max_grid[3] = { m_max_grid.x, m_max_grid.y, m_max_grid.z };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        max_radius = std::max(max_radius, std::fabs(query_coords[axis] - (min_grid[axis] - 1) * m_cell_size));
+        max_radius = std::max(max_radius, std::fabs(query_coords[axis] - (max_grid[axis] + 1) * m_cell_size));
+    }
+
+    // All points within radius of query_pt have been seen after a pass, so
+    // the search is done once the k-th candidate lies within radius.
+    while (k > 0)
+    {
+        queue.clear();
+        FPoint3 min_loc = query_pt - FPoint3(radius, radius, radius);
+        FPoint3 max_loc = query_pt + FPoint3(radius, radius, radius);
+        float threshold = std::numeric_limits<float>::max();
+        processCells(min_loc, max_loc,
+            [this, &query_pt, &queue, &threshold, k](uint32_t slot_begin, uint32_t slot_end)
+            {
+                filterSlots(slot_begin, slot_end, query_pt, threshold,
+                    [this, &queue, &threshold, k](uint32_t slot, float dist2)
+                    {
+                        Neighbor elem = { m_point_indices[slot], dist2 };
+                        if (queue.size() == k && !(elem < queue.back())) return;
+                        queue.insert(std::upper_bound(queue.begin(), queue.end(), elem), elem);
+                        if (queue.size() > k) queue.pop_back();
+                        if (queue.size() == k) threshold = queue.back().dist2;
+                    });
+                return true;
+            });
+        if (queue.size() == k && queue.back().dist2 <= radius * radius) break;
+        if (radius > max_radius) break;
+        radius += m_cell_size;
+    }
+}
+
+inline bool PointIndexGrid::pickAlongRay(const FPoint3& origin, const FPoint3& direction, coord_t radius, float radius_slope,
+                                         unsigned int& hit_idx, float& hit_t) const
+{
+    bool found = false;
+    float best_t = std::numeric_limits<float>::max();
+    auto test_slots = [&](uint32_t slot_begin, uint32_t slot_end)
+    {
+        for (uint32_t slot = slot_begin; slot < slot_end; slot++)
+        {
+            float vx = m_xs[slot] - origin.x;
+            float vy = m_ys[slot] - origin.y;
+            float vz = m_zs[slot] - origin.z;
+            float pt_t = vx * direction.x + vy * direction.y + vz * direction.z;
+            if (!(pt_t >= 0) || pt_t >= best_t) continue;
+            float allowed = radius + radius_slope * pt_t;
+            float dist2 = vx * vx + vy * vy + vz * vz - pt_t * pt_t;
+            if (dist2 > allowed * allowed) continue;
+            found = true;
+            best_t = pt_t;
+            hit_idx = m_point_indices[slot];
+        }
+        return true;
+    };
+
+    // Points moved out of their cells may be anywhere
+    test_slots(getOverflowBegin(), m_slot_count);
+    if (m_cell_count > 0) walkRay(origin, direction, radius, radius_slope, found, best_t, test_slots);
+    if (found) hit_t = best_t;
+    return found;
+}
+
+template<typename Func>
+void PointIndexGrid::walkRay(const FPoint3& origin, const FPoint3& direction, coord_t radius, float radius_slope,
+                             const bool& found, const float& best_t, const Func& test_slots) const
+{
+    // Clip the ray to where its hit distance reaches the bounds of all cells.
+    // Truncation makes cell 0 twice as large, hence the extra cell on both sides.
+    const float origin_coords[3] = { origin.x, origin.y, origin.z };
+    const float dir_coords[3] = { direction.x, direction.y, direction.z };
+    const grid_coord_t min_grid[3] = { m_min_grid.x, m_min_grid.y, m_min_grid.z };
+    const grid_coord_t max_grid[3] = { m_max_grid.x, m_max_grid.y, m_max_grid.z };
+    float t_enter = 0.0f, t_exit = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float lo = (min_grid[axis] - 1) * m_cell_size;
+        float hi = (max_grid[axis] + 1) * m_cell_size;
+        // No point of the bounds lies further along the ray than their far corner
+        float far = (dir_coords[axis] > 0) ? hi : lo;
+        t_exit += (far - origin_coords[axis]) * dir_coords[axis];
+    }
+    for (int axis = 0; axis < 3 && t_enter <= t_exit; axis++)
+    {
+        float lo = (min_grid[axis] - 1) * m_cell_size;
+        float hi = (max_grid[axis] + 1) * m_cell_size;
+        // Both bounds widened by the hit distance, as factor * t >= offset
+        const float factors[2] = { dir_coords[axis] + radius_slope, radius_slope - dir_coords[axis] };
+        const float offsets[2] = { lo - radius - origin_coords[axis], origin_coords[axis] - hi - radius };
+        for (int side = 0; side < 2; side++)
+        {
+            if (factors[side] > 0) t_enter = std::max(t_enter, offsets[side] / factors[side]);
+            else if (factors[side] < 0) t_exit = std::min(t_exit, offsets[side] / factors[side]);
+            else if (offsets[side] > 0) return;
+        }
+    }
+    if (t_enter > t_exit) return;
+
+    // Step by about the hit distance, so that each box spans a few cells and
+    // overlaps the previous one, whose cells are skipped. The box bounds move
+    // monotonically along the ray, so no cell is visited twice.
+    grid_coord_t prev_min[3] = { 1, 1, 1 }, prev_max[3] = { 0, 0, 0 };
+    std::vector<cell_key_t> candidates;
+    for (float t = t_enter; t <= t_exit; )
+    {
+        const float step = m_cell_size + radius + radius_slope * t;
+        // Every point in the boxes from here on lies at least this far along the ray.
+        const float margin = radius + radius_slope * (t + step);
+        if (found && t - margin > best_t) break;
+
+        grid_coord_t box_min[3], box_max[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float seg_begin = origin_coords[axis] + dir_coords[axis] * t;
+            float seg_end = origin_coords[axis] + dir_coords[axis] * (t + step);
+            box_min[axis] = std::max(toGridCoord(std::min(seg_begin, seg_end) - margin), min_grid[axis]);
+            box_max[axis] = std::min(toGridCoord(std::max(seg_begin, seg_end) + margin), max_grid[axis]);
+        }
+        for (grid_coord_t grid_z = box_min[2]; grid_z <= box_max[2]; ++grid_z)
+        {
+            for (grid_coord_t grid_y = box_min[1]; grid_y <= box_max[1]; ++grid_y)
+            {
+                bool in_prev = grid_z >= prev_min[2] && grid_z <= prev_max[2] && grid_y >= prev_min[1] && grid_y <= prev_max[1];
+                for (grid_coord_t grid_x = box_min[0]; grid_x <= box_max[0]; ++grid_x)
+                {
+                    if (in_prev && grid_x >= prev_min[0] && grid_x <= prev_max[0])
+                    {
+                        grid_x = prev_max[0];
+                        continue;
+                    }
+                    if (!cellNearRay(grid_x, grid_y, grid_z, origin, direction, radius, radius_slope)) continue;
+                    cell_key_t key = toCellKey(grid_x, grid_y, grid_z);
+#ifdef __GNUC__
+                    __builtin_prefetch(m_table + (hashKey(key) >> m_table_shift));
+#endif
+                    candidates.push_back(key);
+                }
+            }
+        }
+        // Most cells near a ray are empty, so the lookups are mostly cache misses;
+        // prefetching them all first lets them overlap.
+        for (cell_key_t key : candidates)
+        {
+            uint32_t cell_idx = findCellByKey(key);
+            if (cell_idx == NO_CELL) continue;
+            test_slots(m_cell_begin[cell_idx], m_cell_begin[cell_idx + 1]);
+        }
+        candidates.clear();
+        std::copy(box_min, box_min + 3, prev_min);
+        std::copy(box_max, box_max + 3, prev_max);
+        t += step;
+    }
+}
+
+inline bool PointIndexGrid::cellNearRay(grid_coord_t x, grid_coord_t y, grid_coord_t z, const FPoint3& origin,
+                                        const FPoint3& direction, coord_t radius, float radius_slope) const
+{
+    // Truncation makes cell 0 span both sides of zero
+    const grid_coord_t grid[3] = { x, y, z };
+    const float origin_coords[3] = { origin.x, origin.y, origin.z };
+    const float dir_coords[3] = { direction.x, direction.y, direction.z };
+    float v[3], half_diag2 = 0.0f, center_t = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float center = (grid[axis] > 0) ? (grid[axis] + 0.5f) * m_cell_size
+                     : (grid[axis] < 0) ? (grid[axis] - 0.5f) * m_cell_size : 0.0f;
+        float half_size = (grid[axis] == 0) ? m_cell_size : 0.5f * m_cell_size;
+        half_diag2 += half_size * half_size;
+        v[axis] = center - origin_coords[axis];
+        center_t += v[axis] * dir_coords[axis];
+    }
+    const float half_diag = std::sqrt(half_diag2);
+    const float dist2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2] - center_t * center_t;
+    const float allowed = half_diag + radius + radius_slope * std::max(0.0f, center_t + half_diag);
+    return dist2 <= allowed * allowed;
+}
+
+inline bool PointIndexGrid::updatePoints(const float* pos_array, const uint32_t* indices, size_t n, float* old_positions)
+{
+    if (m_slot_of_point.empty() && m_point_count > 0)
+    {
+        m_slot_of_point.assign(m_point_count, uint32_t(NO_CELL));
+        parallelFor(m_slot_count,
+            [this](size_t slot)
+            {
+                if (!std::isnan(m_xs[slot])) m_slot_of_point[m_point_indices[slot]] = (uint32_t)slot;
+            });
+    }
+
+    // Decide for every point whether it can stay in its slot
+    std::vector<char> stays(n);
+    uint32_t overflow_count = m_slot_count - getOverflowBegin();
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint32_t point_idx = indices[i];
+        const uint32_t slot = (point_idx < m_slot_of_point.size()) ? m_slot_of_point[point_idx] : uint32_t(NO_CELL);
+        const float* p = pos_array + size_t(point_idx) * 3;
+        if (old_positions)
+        {
+            const float nan = std::numeric_limits<float>::quiet_NaN();
+            old_positions[i * 3] = (slot == NO_CELL) ? nan : m_xs[slot];
+            old_positions[i * 3 + 1] = (slot == NO_CELL) ? nan : m_ys[slot];
+            old_positions[i * 3 + 2] = (slot == NO_CELL) ? nan : m_zs[slot];
+        }
+        if (slot == NO_CELL)
+        {
+            stays[i] = false;
+        }
+        else if (slot >= getOverflowBegin())
+        {
+            stays[i] = true;
+        }
+        else
+        {
+            uint32_t cell_idx = uint32_t(std::upper_bound(m_cell_begin, m_cell_begin + m_cell_count + 1, slot) - m_cell_begin) - 1;
+            stays[i] = findCell(toGridCoord(p[0]), toGridCoord(p[1]), toGridCoord(p[2])) == cell_idx;
+        }
+        if (!stays[i]) overflow_count++;
+    }
+    const uint32_t max_overflow = std::max(1024u, m_point_count / 4096);
+    if (overflow_count > max_overflow) return false;
+
+    // A mapped grid is copied once before it is changed
+    if (m_mapped_file)
+    {
+        const uint64_t table_size = m_table_mask + 1;
+        m_cell_keys_store.assign(m_cell_keys, m_cell_keys + m_cell_count);
+        m_cell_begin_store.assign(m_cell_begin, m_cell_begin + m_cell_count + 1);
+        m_point_indices_store.assign(m_point_indices, m_point_indices + m_slot_count);
+        m_xs_store.assign(m_xs, m_xs + m_slot_count);
+        m_ys_store.assign(m_ys, m_ys + m_slot_count);
+        m_zs_store.assign(m_zs, m_zs + m_slot_count);
+        m_table_store.assign(m_table, m_table + table_size);
+        pointAtOwnedStorage();
+        m_mapped_file.reset();
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint32_t point_idx = indices[i];
+        const float* p = pos_array + size_t(point_idx) * 3;
+        if (stays[i])
+        {
+            const uint32_t slot = m_slot_of_point[point_idx];
+            m_xs_store[slot] = p[0];
+            m_ys_store[slot] = p[1];
+            m_zs_store[slot] = p[2];
+            continue;
+        }
+        if (point_idx < m_slot_of_point.size() && m_slot_of_point[point_idx] != NO_CELL)
+        {
+            // Blank out the old slot, NaN coordinates never pass a distance test
+            const uint32_t slot = m_slot_of_point[point_idx];
+            m_xs_store[slot] = m_ys_store[slot] = m_zs_store[slot] = std::numeric_limits<float>::quiet_NaN();
+        }
+        if (point_idx >= m_slot_of_point.size()) m_slot_of_point.resize(point_idx + 1, uint32_t(NO_CELL));
+        if (point_idx >= m_point_count) m_point_count = point_idx + 1;
+        m_slot_of_point[point_idx] = (uint32_t)m_point_indices_store.size();
+        m_point_indices_store.push_back(point_idx);
+        m_xs_store.push_back(p[0]);
+        m_ys_store.push_back(p[1]);
+        m_zs_store.push_back(p[2]);
+    }
+    m_slot_count = (uint32_t)m_point_indices_store.size();
+    pointAtOwnedStorage();
+    return true;
+}
+
+inline bool PointIndexGrid::save(const char* filename, uint64_t content_hash) const
+{
+    if (m_slot_count != m_point_count || getOverflowBegin() != m_point_count) return false;
+
+    const uint64_t alignment = 64;
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "PNTSIDX", 8);
+    header.version = 1;
+    header.byte_order = 0x01020304;
+    header.content_hash = content_hash;
+    header.cell_size = m_cell_size;
+    header.min_grid[0] = m_min_grid.x;  header.min_grid[1] = m_min_grid.y;  header.min_grid[2] = m_min_grid.z;
+    header.max_grid[0] = m_max_grid.x;  header.max_grid[1] = m_max_grid.y;  header.max_grid[2] = m_max_grid.z;
+    header.point_count = m_point_count;
+    header.cell_count = m_cell_count;
+    header.table_bits = 64 - m_table_shift;
+    header.dims[0] = m_dims[0];     header.dims[1] = m_dims[1];     header.dims[2] = m_dims[2];
+
+    const void* arrays[7] = { m_cell_keys, m_cell_begin, m_point_indices, m_xs, m_ys, m_zs, m_table };
+    const uint64_t sizes[7] = {
+        uint64_t(m_cell_count) * sizeof(cell_key_t), (uint64_t(m_cell_count) + 1) * sizeof(uint32_t),
+        uint64_t(m_point_count) * sizeof(uint32_t), uint64_t(m_point_count) * sizeof(float),
+        uint64_t(m_point_count) * sizeof(float), uint64_t(m_point_count) * sizeof(float),
+        (m_table_mask + 1) * sizeof(uint32_t) };
+    uint64_t* offsets[7] = { &header.cell_keys_offset, &header.cell_begin_offset, &header.point_indices_offset,
+        &header.xs_offset, &header.ys_offset, &header.zs_offset, &header.table_offset };
+    uint64_t offset = sizeof(FileHeader);
+    for (int array_idx = 0; array_idx < 7; array_idx++)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        *offsets[array_idx] = offset;
+        offset += sizes[array_idx];
+    }
+    header.file_size = offset;
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    const char padding[64] = { 0 };
+    offset = sizeof(FileHeader);
+    for (int array_idx = 0; array_idx < 7 && ok; array_idx++)
+    {
+        ok = fwrite(padding, 1, *offsets[array_idx] - offset, fp) == *offsets[array_idx] - offset;
+        ok = ok && fwrite(arrays[array_idx], 1, sizes[array_idx], fp) == sizes[array_idx];
+        offset = *offsets[array_idx] + sizes[array_idx];
+    }
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) remove(filename);
+    return ok;
+}
+
+inline bool PointIndexGrid::load(const char* filename, uint64_t content_hash)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile);
+    if (!file->open(filename) || file->size() < sizeof(FileHeader)) return false;
+
+    FileHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, "PNTSIDX", 8) != 0 || header.version != 1 || header.byte_order != 0x01020304
+        || header.content_hash != content_hash || header.file_size != file->size()
+        || header.table_bits == 0 || header.table_bits > 32 || !(header.cell_size > 0))
+    {
+        return false;
+    }
+    const uint64_t table_size = uint64_t(1) << header.table_bits;
+    const uint64_t ends[7] = {
+        header.cell_keys_offset + uint64_t(header.cell_count) * sizeof(cell_key_t),
+        header.cell_begin_offset + (uint64_t(header.cell_count) + 1) * sizeof(uint32_t),
+        header.point_indices_offset + uint64_t(header.point_count) * sizeof(uint32_t),
+        header.xs_offset + uint64_t(header.point_count) * sizeof(float),
+        header.ys_offset + uint64_t(header.point_count) * sizeof(float),
+        header.zs_offset + uint64_t(header.point_count) * sizeof(float),
+        header.table_offset + table_size * sizeof(uint32_t) };
+    for (int array_idx = 0; array_idx < 7; array_idx++)
+    {
+        if (ends[array_idx] > header.file_size) return false;
+    }
+
+    clear();
+    m_cell_size = header.cell_size;
+    m_min_grid = GridPoint(header.min_grid[0], header.min_grid[1], header.min_grid[2]);
+    m_max_grid = GridPoint(header.max_grid[0], header.max_grid[1], header.max_grid[2]);
+    m_dims[0] = header.dims[0];     m_dims[1] = header.dims[1];     m_dims[2] = header.dims[2];
+    m_point_count = header.point_count;
+    m_cell_count = header.cell_count;
+    m_slot_count = m_point_count;
+    const char* data = file->data();
+    m_cell_keys = reinterpret_cast<const cell_key_t*>(data + header.cell_keys_offset);
+    m_cell_begin = reinterpret_cast<const uint32_t*>(data + header.cell_begin_offset);
+    m_point_indices = reinterpret_cast<const uint32_t*>(data + header.point_indices_offset);
+    m_xs = reinterpret_cast<const float*>(data + header.xs_offset);
+    m_ys = reinterpret_cast<const float*>(data + header.ys_offset);
+    m_zs = reinterpret_cast<const float*>(data + header.zs_offset);
+    m_table = reinterpret_cast<const uint32_t*>(data + header.table_offset);
+    m_table_mask = table_size - 1;
+    m_table_shift = 64 - header.table_bits;
+    if (!validateArrays())
+    {
+        clear();
+        return false;
+    }
+    m_mapped_file = std::move(file);
+    return true;
+}
+
+inline bool PointIndexGrid::validateArrays() const
+{
+    // The queries index with these values unchecked, so a damaged file must not get through
+    if (m_cell_begin[0] != 0 || m_cell_begin[m_cell_count] != m_slot_count) return false;
+    for (uint32_t cell_idx = 0; cell_idx < m_cell_count; cell_idx++)
+    {
+        if (m_cell_begin[cell_idx] > m_cell_begin[cell_idx + 1]) return false;
+    }
+    for (uint32_t slot = 0; slot < m_slot_count; slot++)
+    {
+        if (m_point_indices[slot] >= m_point_count) return false;
+    }
+    // findCell probes until it meets an empty entry, so the table needs one
+    bool has_empty = false;
+    for (uint64_t pos = 0; pos <= m_table_mask; pos++)
+    {
+        if (m_table[pos] == NO_CELL) has_empty = true;
+        else if (m_table[pos] >= m_cell_count) return false;
+    }
+    return has_empty;
+}
+
+inline uint64_t PointIndexGrid::hashPositions(const float* pos_array, unsigned int pnts_num)
+{
+    const size_t block_size = 1 << 20;
+    const size_t block_count = (size_t(pnts_num) + block_size - 1) / block_size;
+    std::vector<uint64_t> block_hashes(block_count);
+    parallelForChunks(block_count, std::min(getThreadCount(), (unsigned int)std::max(block_count, size_t(1))),
+        [&](unsigned int, size_t block_begin, size_t block_end)
+        {
+            for (size_t block_idx = block_begin; block_idx < block_end; block_idx++)
+            {
+                size_t begin = block_idx * block_size;
+                size_t end = std::min(size_t(pnts_num), begin + block_size);
+                block_hashes[block_idx] = fnv1a(pos_array + begin * 3, (end - begin) * 3 * sizeof(float));
+            }
+        });
+    uint64_t hash = fnv1a(&pnts_num, sizeof(pnts_num));
+    return fnv1a(block_hashes.data(), block_hashes.size() * sizeof(uint64_t), hash);
+}
+
+inline void PointIndexGrid::getRadiusNeighbors(const FPoint3& query_pt, coord_t radius, std::vector<Neighbor>& result, unsigned int max_nn) const
+{
+    result.clear();
+    const float radius2 = radius * radius;
+    FPoint3 min_loc = query_pt - FPoint3(radius, radius, radius);
+    FPoint3 max_loc = query_pt + FPoint3(radius, radius, radius);
+    float threshold = radius2;
+    processCells(min_loc, max_loc,
+        [this, &query_pt, &result, &threshold, max_nn](uint32_t slot_begin, uint32_t slot_end)
+        {
+            filterSlots(slot_begin, slot_end, query_pt, threshold,
+                [this, &result, &threshold, max_nn](uint32_t slot, float dist2)
+                {
+                    Neighbor elem = { m_point_indices[slot], dist2 };
+                    if (max_nn == 0)
+                    {
+                        result.push_back(elem);
+                        return;
+                    }
+                    if (result.size() == max_nn && !(elem < result.back())) return;
+                    result.insert(std::upper_bound(result.begin(), result.end(), elem), elem);
+                    if (result.size() > max_nn) result.pop_back();
+                    if (result.size() == max_nn) threshold = result.back().dist2;
+                });
+            return true;
+        });
+}
+
+inline void PointIndexGrid::getRadiusNeighborsBatch(const float* query_array, unsigned int query_num, coord_t radius,
+                                                    unsigned int max_nn, NeighborBatch& batch) const
+{
+    batch.offsets.resize(query_num + 1);
+    batch.offsets[0] = 0;
+    const unsigned int chunk_count = (query_num < 256) ? 1 : getThreadCount();
+
+    if (max_nn > 0)
+    {
+        // Every query owns a slice of max_nn entries, which is compacted afterwards.
+        batch.neighbors.resize(size_t(query_num) * max_nn);
+        parallelForChunks(query_num, chunk_count,
+            [&](unsigned int, size_t begin, size_t end)
+            {
+                std::vector<Neighbor> result;
+                result.reserve(max_nn + 1);
+                for (size_t query_idx = begin; query_idx < end; query_idx++)
+                {
+                    const float* query = &query_array[query_idx * 3];
+                    getRadiusNeighbors(FPoint3(query[0], query[1], query[2]), radius, result, max_nn);
+                    std::copy(result.begin(), result.end(), batch.neighbors.begin() + query_idx * max_nn);
+                    batch.offsets[query_idx + 1] = (uint32_t)result.size();
+                }
+            });
+        for (unsigned int query_idx = 0; query_idx < query_num; query_idx++)
+        {
+            uint32_t count = batch.offsets[query_idx + 1];
+            uint32_t dst = batch.offsets[query_idx];
+            std::copy(batch.neighbors.begin() + size_t(query_idx) * max_nn,
+                      batch.neighbors.begin() + size_t(query_idx) * max_nn + count,
+                      batch.neighbors.begin() + dst);
+            batch.offsets[query_idx + 1] = dst + count;
+        }
+        batch.neighbors.resize(batch.offsets[query_num]);
+        return;
+    }
+
+    // Without a cap, count the neighbors first and then fill them in place.
+    parallelForChunks(query_num, chunk_count,
+        [&](unsigned int, size_t begin, size_t end)
+        {
+            const float radius2 = radius * radius;
+            for (size_t query_idx = begin; query_idx < end; query_idx++)
+            {
+                const float* query = &query_array[query_idx * 3];
+                uint32_t count = 0;
+                FPoint3 query_pt(query[0], query[1], query[2]);
+                processCells(query_pt - FPoint3(radius, radius, radius), query_pt + FPoint3(radius, radius, radius),
+                    [this, &query_pt, &radius2, &count](uint32_t slot_begin, uint32_t slot_end)
+                    {
+                        filterSlots(slot_begin, slot_end, query_pt, radius2,
+                            [&count](uint32_t, float) { count++; });
+                        return true;
+                    });
+                batch.offsets[query_idx + 1] = count;
+            }
+        });
+    for (unsigned int query_idx = 0; query_idx < query_num; query_idx++)
+    {
+        batch.offsets[query_idx + 1] += batch.offsets[query_idx];
+    }
+    batch.neighbors.resize(batch.offsets[query_num]);
+    parallelForChunks(query_num, chunk_count,
+        [&](unsigned int, size_t begin, size_t end)
+        {
+            std::vector<Neighbor> result;
+            for (size_t query_idx = begin; query_idx < end; query_idx++)
+            {
+                const float* query = &query_array[query_idx * 3];
+                getRadiusNeighbors(FPoint3(query[0], query[1], query[2]), radius, result);
+                std::copy(result.begin(), result.end(), batch.neighbors.begin() + batch.offsets[query_idx]);
+            }
+        });
+}
+
+} // namespace cura
+
+#endif // UTILS_POINT_INDEX_GRID_H
@@ -0,0 +1,73 @@
+#ifndef UTILS_PROGRESS_REPORTER_H
+#define UTILS_PROGRESS_REPORTER_H
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+
+namespace cura {
+
+/*! \brief Reports the progress of a task to stderr, safe to update from several threads.
+ *
+ * Threads add the number of items they finished.  The percentage is printed
+ * on one line, each value at most once and in increasing order, by whichever
+ * thread crosses it.
+ */
+class ProgressReporter
+{
+public:
+    /*!
+     * \param[in] name The name of the task, printed before the percentage.
+     * \param[in] total The number of items of the task.
+     * \param[in] enabled Whether to print anything at all.
+     */
+    ProgressReporter(const char* name, size_t total, bool enabled = true)
+    : m_name(name)
+    , m_total(total)
+    , m_enabled(enabled)
+    , m_done(0)
+    , m_printed_percent(-1)
+    {
+        print(0);
+    }
+
+    /*! \brief Registers \p count more finished items. */
+    void add(size_t count)
+    {
+        if (!m_enabled || m_total == 0) return;
+        size_t done = m_done.fetch_add(count) + count;
+        int percent = int(done * 100 / m_total);
+        if (percent > m_printed_percent.load(std::memory_order_relaxed)) print(percent);
+    }
+
+    /*! \brief Prints 100% and ends the line. */
+    void finish()
+    {
+        if (!m_enabled) return;
+        print(100);
+        std::lock_guard<std::mutex> lock(m_print_mutex);
+        fprintf(stderr, " done.\n");
+    }
+
+private:
+    void print(int percent)
+    {
+        if (!m_enabled) return;
+        std::lock_guard<std::mutex> lock(m_print_mutex);
+        if (percent <= m_printed_percent) return;
+        m_printed_percent = percent;
+        fprintf(stderr, "\r%s... %3d%%", m_name, percent);
+        fflush(stderr);
+    }
+
+    const char* m_name;
+    size_t m_total;
+    bool m_enabled;
+    std::atomic<size_t> m_done;
+    std::atomic<int> m_printed_percent;
+    std::mutex m_print_mutex;
+};
+
+} // namespace cura
+
+#endif // UTILS_PROGRESS_REPORTER_H
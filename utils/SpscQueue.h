@@ -0,0 +1,76 @@
+#ifndef UTILS_SPSC_QUEUE_H
+#define UTILS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace cura {
+
+/*! \brief A bounded FIFO queue between one producer thread and one consumer thread, without locks.
+ *
+ * Only the producer may call push and only the consumer may call pop; size
+ * may be called from either. Neither call waits: a full queue refuses the
+ * item, which lets the producer choose between waiting and dropping it.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    /*! \param[in] capacity The most items the queue holds at once. */
+    explicit SpscQueue(size_t capacity)
+    : m_items(capacity + 1)
+    , m_head(0)
+    , m_tail(0)
+    {
+    }
+
+    /*! \brief Appends \p item, moved from, unless the queue is full.
+     *
+     * \return Whether the item was appended.
+     */
+    bool push(T& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) % m_items.size();
+        if (next == m_head.load(std::memory_order_acquire)) return false;
+        m_items[tail] = std::move(item);
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /*! \brief Takes the oldest item into \p item, unless the queue is empty.
+     *
+     * \return Whether an item was taken.
+     */
+    bool pop(T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+        item = std::move(m_items[head]);
+        m_head.store((head + 1) % m_items.size(), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return (tail + m_items.size() - head) % m_items.size();
+    }
+
+    size_t capacity() const { return m_items.size() - 1; }
+
+private:
+    std::vector<T> m_items; //!< One slot more than the capacity, so that a full queue differs from an empty one
+    std::atomic<size_t> m_head; //!< The next item to pop, written by the consumer
+    // Keeps the indices on separate cache lines, so that the producer and the consumer do not
+    // invalidate each other's (padding rather than alignas, which operator new ignores before C++17)
+    char m_padding[64];
+    std::atomic<size_t> m_tail; //!< The next slot to push into, written by the producer
+};
+
+} // namespace cura
+
+#endif // UTILS_SPSC_QUEUE_H
@@ -0,0 +1,342 @@
+#ifndef UTILS_THREAD_POOL_H
+#define UTILS_THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cura {
+
+/*! \brief Pool of worker threads which process index ranges with work stealing.
+ *
+ * A parallelFor splits its range evenly over the threads. Each thread takes
+ * grain-sized pieces from the front of its own range, and when that is
+ * exhausted steals the back half of the range of another thread, so uneven
+ * work per item still keeps all threads busy.
+ *
+ * The calling thread works as thread 0. A parallelFor issued from inside a
+ * running parallelFor runs serially on the calling thread.
+ *
+ * A pool runs one parallelFor at a time; one from another thread waits for
+ * it. Threads which must not wait for each other's loops give one of them a
+ * pool of its own, see Use.
+ *
+ * The number of threads defaults to the hardware concurrency and can be set
+ * with the PNTWORKS_THREADS environment variable.
+ */
+class ThreadPool
+{
+public:
+    /*! \brief The pool of the parallel loops on the calling thread.
+     *
+     * This is the pool shared by all threads, unless the calling thread is
+     * within a Use of another pool or is a worker of another pool.
+     */
+    static ThreadPool& instance()
+    {
+        ThreadPool* pool = threadPool();
+        if (pool) return *pool;
+        static ThreadPool shared_pool;
+        return shared_pool;
+    }
+
+    /*! \brief Makes instance() return \p pool on the calling thread while it exists. */
+    class Use
+    {
+    public:
+        explicit Use(ThreadPool& pool) : m_previous(threadPool()) { threadPool() = &pool; }
+        ~Use() { threadPool() = m_previous; }
+
+    private:
+        Use(const Use&);
+        Use& operator=(const Use&);
+
+        ThreadPool* m_previous;
+    };
+
+    /*! \brief A pool of its own, see Use.
+     *
+     * \param[in] thread_count The number of threads, including the calling thread.
+     */
+    explicit ThreadPool(unsigned int thread_count)
+    : m_thread_count(1)
+    , m_job(nullptr)
+    , m_grain(1)
+    , m_job_id(0)
+    , m_busy_workers(0)
+    , m_stop(false)
+    {
+        startWorkers(std::max(1u, thread_count));
+    }
+
+    ~ThreadPool() { stopWorkers(); }
+
+    unsigned int getThreadCount() const { return m_thread_count; }
+
+    /*! \brief The index of the calling thread within the running parallelFor.
+     *
+     * Ranges from 0 to getThreadCount() - 1, which makes it usable as an
+     * index into per-thread scratch buffers.
+     */
+    static unsigned int getThreadIndex() { return threadIndex(); }
+
+    /*! \brief Processes [0, \p n) in parallel.
+     *
+     * \param[in] n The number of items.
+     * \param[in] grain The number of items taken at once by a thread.
+     * \param[in] func Called as func(begin, end, thread_idx) for disjoint
+     *    ranges which together cover [0, \p n).
+     */
+    template<typename Func>
+    void parallelFor(size_t n, size_t grain, const Func& func)
+    {
+        if (n == 0) return;
+        grain = std::max(size_t(1), grain);
+        if (m_thread_count == 1 || n <= grain || inJob())
+        {
+            func(size_t(0), n, threadIndex());
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit_lock(m_submit_mutex);
+        const std::function<void(size_t, size_t, unsigned int)> job = func;
+        for (unsigned int thread_idx = 0; thread_idx < m_thread_count; thread_idx++)
+        {
+            std::lock_guard<std::mutex> range_lock(m_ranges[thread_idx].mutex);
+            m_ranges[thread_idx].begin = n * thread_idx / m_thread_count;
+            m_ranges[thread_idx].end = n * (thread_idx + 1) / m_thread_count;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_grain = grain;
+            m_busy_workers = m_thread_count - 1;
+            m_job_id++;
+        }
+        m_job_cv.notify_all();
+
+        runJob(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]() { return m_busy_workers == 0; });
+        m_job = nullptr;
+    }
+
+private:
+    struct WorkRange
+    {
+        std::mutex mutex;
+        size_t begin;
+        size_t end;
+    };
+
+    ThreadPool()
+    : m_thread_count(1)
+    , m_job(nullptr)
+    , m_grain(1)
+    , m_job_id(0)
+    , m_busy_workers(0)
+    , m_stop(false)
+    {
+        unsigned int thread_count = std::thread::hardware_concurrency();
+        const char* env = getenv("PNTWORKS_THREADS");
+        if (env && atoi(env) > 0) thread_count = atoi(env);
+        startWorkers(std::max(1u, thread_count));
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    static unsigned int& threadIndex()
+    {
+        static thread_local unsigned int thread_idx = 0;
+        return thread_idx;
+    }
+
+    static bool& inJob()
+    {
+        static thread_local bool in_job = false;
+        return in_job;
+    }
+
+    /*! \brief The pool set by Use, or the own pool on a worker; null for the shared pool. */
+    static ThreadPool*& threadPool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    void startWorkers(unsigned int thread_count)
+    {
+        m_thread_count = thread_count;
+        m_ranges.reset(new WorkRange[thread_count]);
+        for (unsigned int thread_idx = 0; thread_idx < thread_count; thread_idx++)
+        {
+            m_ranges[thread_idx].begin = m_ranges[thread_idx].end = 0;
+        }
+        uint64_t job_id;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = false;
+            job_id = m_job_id;
+        }
+        // The workers wait for the next job, not the last one
+        for (unsigned int thread_idx = 1; thread_idx < thread_count; thread_idx++)
+        {
+            m_threads.emplace_back(&ThreadPool::workerLoop, this, thread_idx, job_id);
+        }
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_job_cv.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+
+    void workerLoop(unsigned int thread_idx, uint64_t last_job_id)
+    {
+        threadIndex() = thread_idx;
+        threadPool() = this;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_job_cv.wait(lock, [this, last_job_id]() { return m_stop || m_job_id != last_job_id; });
+                if (m_stop) return;
+                last_job_id = m_job_id;
+            }
+            runJob(thread_idx);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy_workers--;
+            }
+            m_done_cv.notify_one();
+        }
+    }
+
+    void runJob(unsigned int thread_idx)
+    {
+        inJob() = true;
+        size_t begin, end;
+        while (takeWork(thread_idx, begin, end))
+        {
+            (*m_job)(begin, end, thread_idx);
+        }
+        inJob() = false;
+    }
+
+    /*! \brief Takes the next piece of work for \p thread_idx, stealing if its own range is empty. */
+    bool takeWork(unsigned int thread_idx, size_t& begin, size_t& end)
+    {
+        for (unsigned int offset = 0; offset < m_thread_count; offset++)
+        {
+            WorkRange& range = m_ranges[(thread_idx + offset) % m_thread_count];
+            std::unique_lock<std::mutex> range_lock(range.mutex);
+            size_t size = range.end - range.begin;
+            if (size == 0) continue;
+            if (offset == 0 || size <= m_grain)
+            {
+                begin = range.begin;
+                end = range.begin + std::min(size, m_grain);
+                range.begin = end;
+                return true;
+            }
+            // Steal the back half, keep a grain of it and leave the rest in the own range.
+            size_t mid = range.begin + size / 2;
+            size_t stolen_end = range.end;
+            range.end = mid;
+            range_lock.unlock();
+            begin = mid;
+            end = std::min(stolen_end, mid + m_grain);
+            WorkRange& own = m_ranges[thread_idx];
+            std::lock_guard<std::mutex> own_lock(own.mutex);
+            own.begin = end;
+            own.end = stolen_end;
+            return true;
+        }
+        return false;
+    }
+
+    unsigned int m_thread_count;
+    std::vector<std::thread> m_threads;
+    std::unique_ptr<WorkRange[]> m_ranges;
+
+    std::mutex m_submit_mutex;  //!< Serializes parallelFor calls from different threads.
+    std::mutex m_mutex;         //!< Guards the job state below.
+    std::condition_variable m_job_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(size_t, size_t, unsigned int)>* m_job;
+    size_t m_grain;
+    uint64_t m_job_id;
+    unsigned int m_busy_workers;
+    bool m_stop;
+};
+
+/*! \brief Number of threads used by the parallel loops.
+ *
+ * \return The thread count of ThreadPool::instance() on the calling thread.
+ */
+inline unsigned int getThreadCount()
+{
+    return ThreadPool::instance().getThreadCount();
+}
+
+/*! \brief Splits [0, \p n) into \p chunk_count contiguous chunks and processes them in parallel.
+ *
+ * The chunk boundaries only depend on \p n and \p chunk_count, so callers
+ * may keep per-chunk state (e.g. histograms) and combine it afterwards in
+ * chunk order to get deterministic results.
+ *
+ * \param[in] n The number of items.
+ * \param[in] chunk_count The number of chunks to split the items into.
+ * \param[in] func Called as func(chunk_idx, begin, end) for each chunk.
+ */
+template<typename Func>
+void parallelForChunks(size_t n, unsigned int chunk_count, const Func& func)
+{
+    chunk_count = std::max(1u, chunk_count);
+    ThreadPool::instance().parallelFor(chunk_count, 1,
+        [n, chunk_count, &func](size_t chunk_begin, size_t chunk_end, unsigned int)
+        {
+            for (size_t chunk_idx = chunk_begin; chunk_idx < chunk_end; chunk_idx++)
+            {
+                func((unsigned int)chunk_idx, n * chunk_idx / chunk_count, n * (chunk_idx + 1) / chunk_count);
+            }
+        });
+}
+
+/*! \brief Processes [0, \p n) in parallel.
+ *
+ * \param[in] n The number of items.
+ * \param[in] func Called as func(idx) for each item.
+ */
+template<typename Func>
+void parallelFor(size_t n, const Func& func)
+{
+    ThreadPool::instance().parallelFor(n, 1024,
+        [&func](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t idx = begin; idx < end; idx++)
+            {
+                func(idx);
+            }
+        });
+}
+
+} // namespace cura
+
+#endif // UTILS_THREAD_POOL_H